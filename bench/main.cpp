@@ -0,0 +1,364 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Native throughput benchmarks
+// Run with `pio run -e bench -t exec`
+// Prints one JSON object keyed by benchmark name, in a fixed order, with the
+// unit of work and nanoseconds per unit, so results can be diffed by script;
+// emulator entries also give MIPS, emulated instructions per microsecond
+// Entries prefixed model_ are modelled time on a simulated Uno bus instead
+
+#include "uMon/z80.hpp"
+#include "uMon/z80/casm.hpp"
+#include "uMon/z80/emu.hpp"
+#include "uMon/sim.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+using namespace uMon::z80;
+
+uint8_t bench_mem[0x10000];
+
+// Output is captured so it can be fed back as input; 64K as IHX fits in 160K
+constexpr const uint32_t BENCH_IO_SIZE = 0x28000;
+char bench_io[BENCH_IO_SIZE];
+uint32_t bench_out = 0; // characters printed
+uint32_t bench_in = 0; // characters read back
+uint32_t bench_lines = 0;
+
+struct BenchAPI : public uMon::Base<BenchAPI> {
+  static void print_char(char c) {
+    if (bench_out < BENCH_IO_SIZE) bench_io[bench_out++] = c;
+  }
+  static void print_string(const char* str) { while (*str != '\0') print_char(*str++); }
+  static void newline() { print_char('\n'); ++bench_lines; }
+  static char input_char() { return bench_in < bench_out ? bench_io[bench_in++] : '\n'; }
+  static void prompt_char(char) {}
+  static void prompt_string(const char*) {}
+
+  static uint8_t read_byte(uint16_t addr) { return bench_mem[addr]; }
+  static void write_byte(uint16_t addr, uint8_t data) { bench_mem[addr] = data; }
+};
+
+using Sim = uMon::SimAPI<BenchAPI>;
+
+void clear_io() {
+  bench_out = 0;
+  bench_in = 0;
+  bench_lines = 0;
+}
+
+// Pseudo-random 64K image, the same every run
+void load_image() {
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < 0x10000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    bench_mem[i] = seed >> 16;
+  }
+}
+
+// Mix of loads, ALU, indexed memory, branches and calls
+uMON_Z80_ASM(EmuMixed, 0x0000,
+  "start: LD SP,$0000\n"
+  "outer: LD IX,$8000\n"
+  "       LD B,0\n"
+  "       XOR A\n"
+  "loop:  ADD A,(IX+0)\n"
+  "       LD (IX+1),A\n"
+  "       INC IX\n"
+  "       RLCA\n"
+  "       CALL sub\n"
+  "       DJNZ loop\n"
+  "       JP outer\n"
+  "sub:   LD HL,$1234\n"
+  "       ADD HL,DE\n"
+  "       EX DE,HL\n"
+  "       RET");
+
+// 16-bit checksum of a buffer, unprefixed ops only
+uMON_Z80_ASM(EmuChecksum, 0x0000,
+  "start: LD SP,$0000\n"
+  "outer: LD HL,$8000\n"
+  "       LD DE,0\n"
+  "       LD C,4\n"
+  "page:  LD B,0\n"
+  "loop:  LD A,(HL)\n"
+  "       ADD A,E\n"
+  "       LD E,A\n"
+  "       JR NC,next\n"
+  "       INC D\n"
+  "next:  INC HL\n"
+  "       DJNZ loop\n"
+  "       DEC C\n"
+  "       JR NZ,page\n"
+  "       JP outer");
+
+double elapsed_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Code>
+void load_code() {
+  for (uint32_t i = 0; i < 0x400; ++i) {
+    bench_mem[0x8000 + i] = i * 37;
+  }
+  casm::upload<BenchAPI, Code>();
+}
+
+// Average T-states per instruction of Code
+template <typename Code>
+double bench_cpi() {
+  constexpr const uint32_t N_STEPS = 1000000;
+  load_code<Code>();
+  static Cpu<BenchAPI> cpu;
+  cpu.reset();
+  cpu.pc = Code::ORG;
+  for (uint32_t i = 0; i < N_STEPS; ++i) {
+    cpu.step();
+  }
+  return double(cpu.cycles) / N_STEPS;
+}
+
+// Emulated clock rate of Code running on Cpu, in MHz
+template <typename Cpu, typename Code>
+double bench_mhz() {
+  constexpr const uint32_t N_CYCLES = 200000000;
+  load_code<Code>();
+  static Cpu cpu;
+  cpu.reset();
+  cpu.pc = Code::ORG;
+  auto start = std::chrono::steady_clock::now();
+  cpu.run(0xFFFF, N_CYCLES); // code never reaches $FFFF
+  return cpu.cycles / elapsed_since(start) / 1e6;
+}
+
+// Print result as a JSON member; call with name == nullptr to close object
+// If is_mips is set, millions of units per second are printed alongside
+void report(const char* name, const char* unit, double ns, bool is_mips = false) {
+  static bool is_first = true;
+  if (name == nullptr) {
+    printf(is_first ? "{}\n" : "\n}\n");
+    return;
+  }
+  printf(is_first ? "{\n" : ",\n");
+  printf("  \"%s\": {\"unit\": \"%s\", \"ns\": %.3f", name, unit, ns);
+  if (is_mips) printf(", \"mips\": %.2f", 1e3 / ns);
+  printf("}");
+  is_first = false;
+}
+
+// Compare interpreter with block cache
+template <typename Code>
+void bench_emu(const char* name, const char* cached_name) {
+  double cpi = bench_cpi<Code>();
+  double plain = bench_mhz<Cpu<BenchAPI>, Code>();
+  double cached = bench_mhz<Cpu<BenchAPI, 64>, Code>();
+  report(name, "instruction", 1e3 * cpi / plain, true);
+  report(cached_name, "instruction", 1e3 * cpi / cached, true);
+}
+
+// Repeat fn until at least 100 ms have passed; fn returns units of work done
+// Returns nanoseconds per unit
+template <typename F>
+double time_per_unit(F fn) {
+  uint64_t units = 0;
+  auto start = std::chrono::steady_clock::now();
+  double elapsed;
+  do {
+    units += fn();
+    elapsed = elapsed_since(start);
+  } while (elapsed < 0.1);
+  return elapsed * 1e9 / units;
+}
+
+// Modelled nanoseconds per unit of fn run once on the simulated bus
+template <typename F>
+double model_per_unit(F fn) {
+  Sim::clear();
+  const uint32_t units = fn();
+  return double(Sim::elapsed_ns) / units;
+}
+
+// Hex dump of 64K, 256 bytes per call
+template <typename API>
+uint32_t run_hex() {
+  for (uint32_t row = 0; row < 0x10000; row += 0x100) {
+    clear_io();
+    uMon::impl_hex<API, 16, 16>(row, row + 0xFF);
+  }
+  return 0x10000;
+}
+
+// Save 64K-1 bytes as IHX
+template <typename API>
+uint32_t run_save() {
+  clear_io();
+  uMon::impl_save<API>(0, 0xFFFF);
+  return 0xFFFF;
+}
+
+// Load back what run_save printed
+template <typename API>
+uint32_t run_load() {
+  char command[] = "load";
+  const uint32_t saved = bench_out;
+  bench_in = 0;
+  uMon::cmd_load<API>(uCLI::Args(command));
+  bench_out = saved; // drop newline printed after loading
+  return 0xFFFF;
+}
+
+// Overlapping 32K moves, alternating direction
+template <typename API>
+uint32_t run_memmove() {
+  // Vary distance so repeated calls cannot be folded together
+  static uint8_t shift = 0;
+  const uint16_t dest = 0x0100 + ++shift;
+  uMon::impl_memmove<API>(0x0000, 0x7FFF, dest);
+  uMon::impl_memmove<API>(dest, dest + 0x7FFF, 0x0000);
+  return 0x10000;
+}
+
+// Disassemble 64K, not counting label rows
+template <typename API>
+uint32_t run_dasm() {
+  uint32_t count = 0;
+  uint16_t addr = 0;
+  do {
+    clear_io();
+    const uint16_t next = dasm_range<API, 255>(addr, 0xFFFF);
+    count += bench_lines;
+    if (next < addr) break;
+    addr = next;
+  } while (addr != 0);
+  return count - API::get_labels().entries();
+}
+
+void bench_hex() {
+  load_image();
+  report("impl_hex", "byte", time_per_unit(run_hex<BenchAPI>));
+}
+
+void bench_ihx() {
+  load_image();
+  report("impl_save", "byte", time_per_unit(run_save<BenchAPI>));
+  report("cmd_load", "byte", time_per_unit(run_load<BenchAPI>));
+}
+
+void bench_memmove() {
+  load_image();
+  report("impl_memmove", "byte", time_per_unit(run_memmove<BenchAPI>));
+}
+
+// Labels are packed into a buffer indexed by uint8_t, so the most that fit is
+// a few dozen; names L00-L99 are spread over the image until it is full
+void fill_labels(uMon::Labels& labels) {
+  char name[] = "L00";
+  for (uint8_t i = 0; i < 100; ++i) {
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    if (!labels.set_label(name, i * 0x28F)) break;
+  }
+}
+
+void clear_labels(uMon::Labels& labels) {
+  while (labels.entries() > 0) {
+    const char* name;
+    uint16_t addr;
+    labels.get_index(labels.entries() - 1, name, addr);
+    char copy[4]; // name is moved by removal
+    strcpy(copy, name);
+    labels.remove_label(copy);
+  }
+}
+
+// Disassemble 64K of random bytes with labels
+void bench_dasm() {
+  load_image();
+  fill_labels(BenchAPI::get_labels());
+  report("dasm_range", "instruction", time_per_unit(run_dasm<BenchAPI>));
+  clear_labels(BenchAPI::get_labels());
+}
+
+// Parse and assemble a mix of source lines
+void bench_asm() {
+  static const char* const SOURCE[] = {
+    "LD A,(IX+5)", "LD HL,$1234", "ADD A,B", "JR NZ,$0010", "CALL $8000",
+    "PUSH BC", "EX DE,HL", "LDIR", "BIT 7,(IY-2)", "OUT ($10),A",
+    "SBC HL,DE", "RLC (HL)", "LD ($C000),SP", "DJNZ $0004", "RET Z", "IM 1",
+  };
+  constexpr const uint8_t N_SOURCE = sizeof(SOURCE) / sizeof(SOURCE[0]);
+  report("parse_instruction", "instruction", time_per_unit([] {
+    char line[16];
+    for (const char* source : SOURCE) {
+      strcpy(line, source);
+      Instruction inst;
+      parse_instruction<BenchAPI>(inst, uCLI::Tokens(line));
+    }
+    return N_SOURCE;
+  }));
+  static Instruction insts[N_SOURCE];
+  for (uint8_t i = 0; i < N_SOURCE; ++i) {
+    char line[16];
+    strcpy(line, SOURCE[i]);
+    parse_instruction<BenchAPI>(insts[i], uCLI::Tokens(line));
+  }
+  report("asm_instruction", "instruction", time_per_unit([] {
+    uint16_t addr = 0;
+    for (Instruction& inst : insts) {
+      addr += asm_instruction<BenchAPI>(inst, addr);
+    }
+    return N_SOURCE;
+  }));
+}
+
+// Insert, look up and remove as many labels as fit
+void bench_labels() {
+  static uMon::LabelsOwner<255> labels;
+  report("labels_set", "label", time_per_unit([] {
+    fill_labels(labels);
+    const uint8_t count = labels.entries();
+    clear_labels(labels);
+    return count;
+  }));
+  fill_labels(labels);
+  report("labels_get", "lookup", time_per_unit([] {
+    // Name and address lookups of each label
+    for (uint8_t i = 0; i < labels.entries(); ++i) {
+      const char* name;
+      uint16_t addr;
+      labels.get_index(i, name, addr);
+      labels.get_name(addr, name);
+      labels.get_addr(name, addr);
+    }
+    return labels.entries() * 2;
+  }));
+}
+
+// Same commands on the simulated bus, in modelled time
+void bench_model() {
+  load_image();
+  fill_labels(BenchAPI::get_labels());
+  report("model_impl_hex", "byte", model_per_unit(run_hex<Sim>));
+  report("model_impl_save", "byte", model_per_unit(run_save<Sim>));
+  report("model_cmd_load", "byte", model_per_unit(run_load<Sim>));
+  report("model_impl_memmove", "byte", model_per_unit(run_memmove<Sim>));
+  report("model_dasm_range", "instruction", model_per_unit(run_dasm<Sim>));
+  clear_labels(BenchAPI::get_labels());
+}
+
+int main() {
+  bench_hex();
+  bench_ihx();
+  bench_memmove();
+  bench_dasm();
+  bench_asm();
+  bench_labels();
+  bench_model();
+  bench_emu<EmuMixed>("emu_mixed", "emu_mixed_cached");
+  bench_emu<EmuChecksum>("emu_checksum", "emu_checksum_cached");
+  report(nullptr, nullptr, 0);
+  return 0;
+}
@@ -9,6 +9,7 @@
 
 #include <stdint.h>
 #include <ctype.h>
+#include <string.h>
 
 namespace uMon {
 
@@ -68,11 +69,9 @@ uint16_t impl_strcpy(uint16_t start, const char* str) {
   }
 }
 
-// Copy [start, end] to [dest, dest+end-start] (end inclusive)
-template <typename API>
-void impl_memmove(uint16_t start, uint16_t end, uint16_t dest) {
-  uint16_t delta = end - start;
-  uint16_t dest_end = dest + delta;
+// True if copying [start, end] to dest must run from end to start
+inline bool is_memmove_reverse(uint16_t start, uint16_t end, uint16_t dest) {
+  uint16_t dest_end = dest + uint16_t(end - start);
   // Buses narrower than 16-bits introduce cases with ghosting (wrap-around).
   // This logic should work as long as start and dest are both within [0, 2^N),
   // where N is the actual bus width.
@@ -80,7 +79,15 @@ void impl_memmove(uint16_t start, uint16_t end, uint16_t dest) {
   bool a = dest <= end;
   bool b = dest_end < start;
   bool c = dest > start;
-  if ((a && b) || (a && c) || (b && c)) {
+  return (a && b) || (a && c) || (b && c);
+}
+
+// Copy [start, end] to [dest, dest+end-start] (end inclusive)
+template <typename API>
+void impl_memmove(uint16_t start, uint16_t end, uint16_t dest) {
+  uint16_t delta = end - start;
+  uint16_t dest_end = dest + delta;
+  if (is_memmove_reverse(start, end, dest)) {
     // Reverse copy from end to start
     for (uint16_t i = 0; i <= delta; ++i) {
       API::write_byte(dest_end - i, API::read_byte(end - i));
@@ -166,7 +173,7 @@ void cmd_hex(uCLI::Args args) {
   uint16_t next = impl_hex<API, COL_SIZE, MAX_ROWS>(start, end_incl);
   uint16_t part = next - start;
   if (part < size) {
-    set_prompt<API>(args.command(), next, size - part);
+    set_prompt<API>(args.command(), next, uint16_t(size - part));
   }
 }
 
@@ -207,6 +214,29 @@ void cmd_save(uCLI::Args args) {
   impl_save<API, REC_SIZE>(start, size);
 }
 
+// Patch references waiting on name now that it is defined as value
+template <typename API>
+void resolve_fixups(const char* name, uint16_t value) {
+  uint16_t addr;
+  uint8_t kind;
+  while (API::get_fixups().take(name, addr, kind)) {
+    // Build the patch first so it goes out in one write
+    uint8_t patch[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+    uint8_t size = kind == FIXUP_WORD ? 2 : 1;
+    if (kind == FIXUP_REL) {
+      int16_t disp = value - (addr + 1);
+      if (disp < -128 || disp > 127) {
+        API::print_string("too far: $");
+        format_hex16(API::print_char, addr);
+        API::newline();
+        continue;
+      }
+      patch[0] = disp;
+    }
+    API::write_bytes(addr, patch, size);
+  }
+}
+
 template <typename API>
 void cmd_label(uCLI::Args args) {
   auto& labels = API::get_labels();
@@ -218,6 +248,8 @@ void cmd_label(uCLI::Args args) {
       if (labels.set_label(name, addr) == false) {
         API::print_string("full");
         API::newline();
+      } else {
+        resolve_fixups<API>(name, addr);
       }
     } else {
       // Remove label
@@ -235,6 +267,63 @@ void cmd_label(uCLI::Args args) {
       format_hex16(API::print_char, addr);
       API::newline();
     }
+    // Print references still waiting on undefined names
+    auto& fixups = API::get_fixups();
+    uint8_t kind;
+    for (uint8_t i = 0; i < fixups.entries(); ++i) {
+      fixups.get_index(i, name, addr, kind);
+      API::print_string(name);
+      API::print_string("? $");
+      format_hex16(API::print_char, addr);
+      API::newline();
+    }
+  }
+}
+
+const char REGION_STR_CODE[] PROGMEM = "code";
+const char REGION_STR_BYTE[] PROGMEM = "byte";
+const char REGION_STR_WORD[] PROGMEM = "word";
+const char REGION_STR_TEXT[] PROGMEM = "text";
+
+// Names of region types, indexed by REGION_*
+const char* const REGION_STR[] PROGMEM = {
+  REGION_STR_CODE,
+  REGION_STR_BYTE,
+  REGION_STR_WORD,
+  REGION_STR_TEXT,
+};
+
+static_assert(sizeof(REGION_STR) / sizeof(REGION_STR[0]) == REGION_INVALID, "REGION_STR must name every type");
+
+template <typename API>
+void cmd_region(uCLI::Args args) {
+  auto& regions = API::get_regions();
+  if (args.has_next()) {
+    // Mark range as type
+    uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
+    uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+    const char* name = args.next();
+    uint8_t type = 0;
+    while (type < REGION_INVALID && strcasecmp_P(name, (char*)pgm_read_ptr(REGION_STR + type)) != 0) ++type;
+    uMON_FMT_ERROR(API, type == REGION_INVALID, "type", name, return);
+    if (regions.mark(start, start + size - 1, type) == false) {
+      API::print_string("full");
+      API::newline();
+    }
+  } else {
+    // Print list of all regions
+    uint16_t start, end;
+    uint8_t type;
+    for (uint8_t i = 0; i < regions.entries(); ++i) {
+      regions.get_index(i, start, end, type);
+      API::print_char('$');
+      format_hex16(API::print_char, start);
+      API::print_string(" $");
+      format_hex16(API::print_char, end);
+      API::print_char(' ');
+      print_pgm_table<API>(REGION_STR, type);
+      API::newline();
+    }
   }
 }
 
@@ -11,15 +11,20 @@
 // tables in regular RAM and fake the Flash memory macros.
 
 // strings.h is POSIX; may need to use _stricmp instead of strcasecmp on Windows
+#include <stdint.h>
 #include <strings.h>
 
 #define PROGMEM
 
-char pgm_read_byte(const char* ptr) {
+inline char pgm_read_byte(const char* ptr) {
   return *ptr;
 }
 
-const char* pgm_read_ptr(const char* const* ptr) {
+inline const char* pgm_read_ptr(const char* const* ptr) {
+  return *ptr;
+}
+
+inline uint16_t pgm_read_word(const uint16_t* ptr) {
   return *ptr;
 }
 
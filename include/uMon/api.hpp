@@ -3,16 +3,26 @@
 
 #pragma once
 
+#include "uMon/fixups.hpp"
 #include "uMon/labels.hpp"
+#include "uMon/regions.hpp"
 
 namespace uMon {
 
-template <typename T, uint8_t LBL_SIZE = 80>
+template <typename T, uint8_t LBL_SIZE = 80, uint8_t RGN_SIZE = 8, uint8_t FIX_SIZE = 32>
 struct Base {
   static uMon::Labels& get_labels() {
     return labels;
   }
 
+  static uMon::Regions& get_regions() {
+    return regions;
+  }
+
+  static uMon::Fixups& get_fixups() {
+    return fixups;
+  }
+
   // static uANSI::StreamEx& get_stream()
   static void print_char(char c) { T::get_stream().print(c); }
   static void print_string(const char* str) { T::get_stream().print(str); }
@@ -38,11 +48,37 @@ struct Base {
     }
   }
 
+  static void write_bytes(uint16_t addr, const uint8_t* buf, uint8_t size) {
+    for (uint8_t i = 0; i < size; ++i) {
+      T::write_byte(addr + i, buf[i]);
+    }
+  }
+
+  // Separate port space for IN/OUT; floats high with nothing attached
+  static uint8_t read_port(uint16_t) { return 0xFF; }
+  static void write_port(uint16_t, uint8_t) {}
+
+  // Advance emulated devices by T-states
+  // Returns true to request an interrupt with data put on the bus
+  static bool tick_devices(uint8_t, uint8_t&) { return false; }
+
+  // Run target CPU from addr until it halts
+  // Returns false if there is no CPU to run, without touching memory
+  static bool run_cpu(uint16_t) { return false; }
+
 private:
   static uMon::LabelsOwner<LBL_SIZE> labels;
+  static uMon::RegionsOwner<RGN_SIZE> regions;
+  static uMon::FixupsOwner<FIX_SIZE> fixups;
 };
 
-template <typename T, uint8_t N>
-uMon::LabelsOwner<N> Base<T, N>::labels;
+template <typename T, uint8_t N, uint8_t R, uint8_t F>
+uMon::LabelsOwner<N> Base<T, N, R, F>::labels;
+
+template <typename T, uint8_t N, uint8_t R, uint8_t F>
+uMon::RegionsOwner<R> Base<T, N, R, F>::regions;
+
+template <typename T, uint8_t N, uint8_t R, uint8_t F>
+uMon::FixupsOwner<F> Base<T, N, R, F>::fixups;
 
 } // namespace uMon
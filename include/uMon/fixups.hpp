@@ -0,0 +1,57 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+#pragma once
+
+#include <stdint.h>
+
+namespace uMon {
+
+// How a pending reference is patched once its name is defined
+enum {
+  FIXUP_BYTE, // low byte of value
+  FIXUP_WORD, // value as little-endian word
+  FIXUP_REL, // signed displacement from the following byte
+};
+
+// This data structure holds references to undefined names within a fixed
+// size buffer, each with the address and kind of patch to apply
+class Fixups {
+  char* buffer_;
+  uint8_t buf_size_;
+  uint8_t used_ = 0;
+  uint8_t entries_ = 0;
+
+  void remove(uint8_t offset);
+
+public:
+  template <uint8_t N>
+  Fixups(char (&buffer)[N]): Fixups(buffer, N) {}
+  Fixups(char* buffer, uint8_t size): buffer_{buffer}, buf_size_{size} {}
+
+  // Remove default copy ops
+  Fixups(const Fixups&) = delete;
+  Fixups& operator=(const Fixups&) = delete;
+
+  uint8_t entries() const { return entries_; }
+
+  bool get_index(uint8_t index, const char*& name, uint16_t& addr, uint8_t& kind) const;
+
+  // Add reference to name at addr; false if full
+  bool add(const char* name, uint16_t addr, uint8_t kind);
+
+  // Remove a reference to name, returning where and how to patch it
+  bool take(const char* name, uint16_t& addr, uint8_t& kind);
+
+  // Forget references patching addresses in [start, end]
+  void discard(uint16_t start, uint16_t end);
+};
+
+template <uint8_t SIZE>
+class FixupsOwner : public Fixups {
+  char buffer_[SIZE];
+public:
+  FixupsOwner(): Fixups(buffer_) {}
+};
+
+} // namespace uMon
@@ -46,6 +46,26 @@ bool input_hex(T& result) {
   return end == &buf[N];
 }
 
+// Read line of input into buf until CR or LF, returning length
+// Characters past the end of buf are dropped; LF following CR is skipped
+template <typename API>
+uint8_t input_line(char* buf, uint8_t size) {
+  uint8_t len = 0;
+  for (;;) {
+    char c = API::input_char();
+    if (c == '\r' || c == '\n') {
+      if (len == 0 && c == '\n') continue;
+      break;
+    } else if (c == '\b' || c == 0x7F) {
+      if (len > 0) --len;
+    } else if (len < size - 1) {
+      buf[len++] = c == '\t' ? ' ' : c;
+    }
+  }
+  buf[len] = '\0';
+  return len;
+}
+
 // Print single hex digit (or garbage if n > 15)
 template <typename F>
 void format_hex4(F&& print, uint8_t n) {
@@ -122,6 +142,13 @@ void set_prompt(const char* cmd, const T arg, const Var... var)
   }
 }
 
+// Redirect print_char/print_string to the CLI prompt
+template <typename API>
+struct PromptAPI : API {
+  static void print_char(char c) { API::prompt_char(c); }
+  static void print_string(const char* str) { API::prompt_string(str); }
+};
+
 template <typename API>
 void print_pgm_string(const char* str) {
   for (;;) {
@@ -138,6 +165,42 @@ void print_pgm_table(const char* const table[], uint8_t index) {
   print_pgm_string<API>(str);
 }
 
+// Write characters into caller memory; anything past the end is dropped
+// Usable anywhere a print functor is, as in format_hex(buf, n)
+class FormatBuffer {
+  char* const start_;
+  char* ptr_;
+  char* const last_; // reserved for null terminator
+
+public:
+  // Buffer size must be at least 1
+  FormatBuffer(char* buf, size_t size): start_(buf), ptr_(buf), last_(buf + size - 1) {}
+
+  void operator()(char c) { if (ptr_ < last_) *ptr_++ = c; }
+
+  void print_string(const char* str) {
+    while (*str != '\0') (*this)(*str++);
+  }
+
+  void print_pgm_string(const char* str) {
+    for (;;) {
+      char c = pgm_read_byte(str++);
+      if (c == '\0') return;
+      (*this)(c);
+    }
+  }
+
+  void print_pgm_table(const char* const table[], uint8_t index) {
+    print_pgm_string((char*)pgm_read_ptr(table + index));
+  }
+
+  // Null-terminate and return length of string
+  size_t finish() {
+    *ptr_ = '\0';
+    return ptr_ - start_;
+  }
+};
+
 // Find index of string in PROGMEM table
 template <uint8_t N>
 uint8_t pgm_bsearch(const char* const (&table)[N], const char* str) {
@@ -0,0 +1,73 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Compile-time perfect hashing of PROGMEM string tables
+// Each table is paired with a MULT/SEED (found by notes/perfect_hash.py) for
+// which no two case-folded names share a slot, so a lookup costs one hash and
+// one strcasecmp_P against the only candidate
+
+#pragma once
+
+#include "uMon/format.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+
+// Fold case so hashing agrees with strcasecmp
+constexpr uint8_t hash_step(uint8_t hash, uint8_t mult, char c) {
+  return uint8_t(hash * mult + (c | 0x20));
+}
+
+constexpr uint8_t hash_str(const char* str, uint8_t mult, uint8_t hash) {
+  return *str == '\0' ? hash : hash_str(str + 1, mult, hash_step(hash, mult, *str));
+}
+
+// Index of first name hashing to slot, or N if none
+template <uint8_t N>
+constexpr uint8_t hash_find_slot(const char* const (&names)[N], uint8_t slot,
+    uint8_t mult, uint8_t seed, uint8_t mask, uint8_t i = 0) {
+  return i == N ? N
+    : (hash_str(names[i], mult, seed) & mask) == slot ? i
+    : hash_find_slot(names, slot, mult, seed, mask, i + 1);
+}
+
+// True if no two names hash to the same slot
+template <uint8_t N>
+constexpr bool hash_is_perfect(const char* const (&names)[N],
+    uint8_t mult, uint8_t seed, uint8_t mask, uint8_t i = 0) {
+  return i == N || (hash_find_slot(names, hash_str(names[i], mult, seed) & mask, mult, seed, mask) == i
+    && hash_is_perfect(names, mult, seed, mask, i + 1));
+}
+
+// Sequence 0..N-1 for expanding constexpr tables
+template <uint8_t... I> struct IndexSeq {};
+template <uint16_t N, uint8_t... I> struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, I...> {};
+template <uint8_t... I> struct MakeIndexSeq<0, I...> { using type = IndexSeq<I...>; };
+
+// Flash memory table from slot to name index, built from Hash::slot(i)
+// Hash provides MULT, SEED, MASK (one less than a power of 2), and slot(i)
+template <typename Hash, typename Seq = typename MakeIndexSeq<Hash::MASK + 1>::type>
+struct HashSlots;
+
+template <typename Hash, uint8_t... I>
+struct HashSlots<Hash, IndexSeq<I...>> {
+  static const uint8_t table[sizeof...(I)];
+};
+
+template <typename Hash, uint8_t... I>
+const uint8_t HashSlots<Hash, IndexSeq<I...>>::table[sizeof...(I)] PROGMEM = { Hash::slot(I)... };
+
+// Find index of string in PROGMEM table by perfect hash
+template <typename Hash, uint8_t N>
+uint8_t pgm_hash_find(const char* const (&table)[N], const char* str) {
+  uint8_t hash = Hash::SEED;
+  for (const char* c = str; *c != '\0'; ++c) {
+    hash = hash_step(hash, Hash::MULT, *c);
+  }
+  uint8_t index = pgm_read_byte((const char*)&HashSlots<Hash>::table[hash & Hash::MASK]);
+  if (index >= N) return N;
+  return strcasecmp_P(str, (char*)pgm_read_ptr(table + index)) == 0 ? index : N;
+}
+
+} // namespace uMon
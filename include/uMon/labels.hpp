@@ -8,7 +8,7 @@
 namespace uMon {
 
 // This data structure allocates key-value pairs within a fixed size buffer
-// TODO sort by address for binary search on dasm
+// Entries are kept sorted by address so they can be walked with a Cursor
 // TODO maybe refactor with uCLI::History
 class Labels {
   char* buffer_;
@@ -32,6 +32,17 @@ public:
 
   uint8_t entries() const { return entries_; }
 
+  // Position of an entry for walking labels in address order
+  struct Cursor {
+    uint8_t index;
+    uint8_t offset;
+  };
+
+  // Get cursor to first entry with address not less than addr
+  Cursor seek(uint16_t addr) const;
+  void next(Cursor& cursor) const;
+  bool get_cursor(const Cursor& cursor, const char*& name, uint16_t& addr) const;
+
   bool get_index(uint8_t index, const char*& name, uint16_t& addr) const;
   bool get_addr(const char* name, uint16_t& addr) const;
   bool get_name(uint16_t addr, const char*& name) const;
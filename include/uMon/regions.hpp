@@ -0,0 +1,64 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+#pragma once
+
+#include <stdint.h>
+
+namespace uMon {
+
+// How the disassembler should present a range of memory
+enum {
+  REGION_CODE, // instructions (default where no region is marked)
+  REGION_BYTE, // DB $xx,...
+  REGION_WORD, // DW $xxxx,...
+  REGION_TEXT, // DB "text",...
+  REGION_INVALID,
+};
+
+// This data structure keeps a sorted list of non-overlapping address ranges
+// within a fixed size buffer; unmarked addresses are treated as code
+class Regions {
+public:
+  struct Region {
+    uint16_t start;
+    uint16_t end; // inclusive
+    uint8_t type;
+  };
+
+private:
+  Region* buffer_;
+  uint8_t buf_size_;
+  uint8_t entries_ = 0;
+
+  bool insert(uint8_t index, const Region& region);
+  void remove(uint8_t index);
+
+public:
+  template <uint8_t N>
+  Regions(Region (&buffer)[N]): Regions(buffer, N) {}
+  Regions(Region* buffer, uint8_t size): buffer_{buffer}, buf_size_{size} {}
+
+  // Remove default copy ops
+  Regions(const Regions&) = delete;
+  Regions& operator=(const Regions&) = delete;
+
+  uint8_t entries() const { return entries_; }
+
+  bool get_index(uint8_t index, uint16_t& start, uint16_t& end, uint8_t& type) const;
+
+  // Get type of region containing addr and the last address of that type
+  uint8_t get_type(uint16_t addr, uint16_t& end) const;
+
+  // Mark [start, end] as type, replacing what was there; false if full
+  bool mark(uint16_t start, uint16_t end, uint8_t type);
+};
+
+template <uint8_t SIZE>
+class RegionsOwner : public Regions {
+  Region buffer_[SIZE];
+public:
+  RegionsOwner(): Regions(buffer_) {}
+};
+
+} // namespace uMon
@@ -0,0 +1,116 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Simulated bus timing for native builds
+// Wraps an API, passing every access through while adding the time real
+// hardware would take to a running total: taking the bus once per transfer,
+// latching an address unless it follows the last one, each byte moved, and
+// each character sent or received over serial
+// Single-byte reads and writes are one transfer each; read_bytes and
+// write_bytes move a whole block in one transfer
+
+#pragma once
+
+#include <stdint.h>
+
+namespace uMon {
+
+// Modelled costs in nanoseconds, except for baud
+struct BusModel {
+  uint32_t acquire; // request and take the bus for one transfer
+  uint32_t latch; // set an address that does not follow the last
+  uint32_t access; // read or write one byte
+  uint32_t baud; // serial rate at 10 bits per character
+};
+
+// Roughly an Uno driving the bus through shift registers at 115200 baud
+constexpr const BusModel BUS_UNO = { 250, 4000, 500, 115200 };
+
+template <typename API>
+struct SimAPI : API {
+  static BusModel model;
+  static uint64_t elapsed_ns;
+  static uint32_t n_transfers;
+  static uint32_t n_latches;
+  static uint32_t n_chars;
+
+  static void clear() {
+    elapsed_ns = 0;
+    n_transfers = 0;
+    n_latches = 0;
+    n_chars = 0;
+    is_latched_ = false;
+  }
+
+  static uint8_t read_byte(uint16_t addr) {
+    transfer(addr, 1);
+    return API::read_byte(addr);
+  }
+
+  static void write_byte(uint16_t addr, uint8_t data) {
+    transfer(addr, 1);
+    API::write_byte(addr, data);
+  }
+
+  template <uint8_t N>
+  static void read_bytes(uint16_t addr, uint8_t (&buf)[N]) {
+    transfer(addr, N);
+    API::read_bytes(addr, buf);
+  }
+
+  static void write_bytes(uint16_t addr, const uint8_t* buf, uint8_t size) {
+    transfer(addr, size);
+    API::write_bytes(addr, buf, size);
+  }
+
+  static void print_char(char c) {
+    send(1);
+    API::print_char(c);
+  }
+
+  static void print_string(const char* str) {
+    for (const char* c = str; *c != '\0'; ++c) send(1);
+    API::print_string(str);
+  }
+
+  // Sent as CR LF
+  static void newline() {
+    send(2);
+    API::newline();
+  }
+
+  static char input_char() {
+    send(1);
+    return API::input_char();
+  }
+
+private:
+  static uint16_t next_addr_;
+  static bool is_latched_;
+
+  static void transfer(uint16_t addr, uint8_t size) {
+    elapsed_ns += model.acquire + uint32_t(model.access) * size;
+    ++n_transfers;
+    if (!is_latched_ || addr != next_addr_) {
+      elapsed_ns += model.latch;
+      ++n_latches;
+    }
+    next_addr_ = addr + size;
+    is_latched_ = true;
+  }
+
+  static void send(uint8_t count) {
+    elapsed_ns += uint64_t(count) * 10000000000ULL / model.baud;
+    n_chars += count;
+  }
+};
+
+template <typename API> BusModel SimAPI<API>::model = BUS_UNO;
+template <typename API> uint64_t SimAPI<API>::elapsed_ns;
+template <typename API> uint32_t SimAPI<API>::n_transfers;
+template <typename API> uint32_t SimAPI<API>::n_latches;
+template <typename API> uint32_t SimAPI<API>::n_chars;
+template <typename API> uint16_t SimAPI<API>::next_addr_;
+template <typename API> bool SimAPI<API>::is_latched_;
+
+} // namespace uMon
@@ -1,19 +1,37 @@
 // https://github.com/trevor-makes/uMon.git
 // Copyright (c) 2022 Trevor Makes
 
+// Z80 monitor commands: assembler, disassembler and code analysis
+// Host-side tooling is opt-in through its own header so AVR sketches do not
+// pay for it: z80/emu.hpp with z80/debug.hpp, z80/profile.hpp,
+// z80/snapshot.hpp and z80/ports.hpp for emulation, z80/casm.hpp for
+// compile-time assembly, and z80/target.hpp for target-run fill and move
+
 #pragma once
 
 #include "z80/asm.hpp"
 #include "z80/dasm.hpp"
+#include "z80/find.hpp"
+#include "z80/reloc.hpp"
+#include "z80/stack.hpp"
+#include "z80/stats.hpp"
+#include "uMon.hpp"
 #include "uCLI.hpp"
 
+#include <ctype.h>
+#include <string.h>
+
 namespace uMon {
 namespace z80 {
 
+// If symbol is provided, an undefined name parses as a zero immediate and
+// symbol is set to the name; otherwise symbol is left unchanged
+// Wildcards are only accepted if is_pattern is set
 template <typename API>
-bool parse_operand(Operand& op, uCLI::Tokens tokens) {
+bool parse_operand(Operand& op, uCLI::Tokens tokens, const char** symbol = nullptr, bool is_pattern = false) {
   // Handle indirect operand surronded by parentheses
   bool is_indirect = false;
+  bool is_wild_disp = false;
   if (tokens.peek_char() == '(') {
     is_indirect = true;
     tokens.split_at('(');
@@ -29,16 +47,25 @@ bool parse_operand(Operand& op, uCLI::Tokens tokens) {
       is_minus = true;
     }
 
-    // Parse displacement and apply sign
-    uMON_OPTION_UINT(API, uint16_t, disp, 0, disp_tok, return false);
-    op.value = is_minus ? -disp : disp;
+    // Parse displacement and apply sign, or match any with '*'
+    if (disp_tok.peek_char() == '*') {
+      uMON_FMT_ERROR(API, !is_pattern, "arg", disp_tok.next(), return false);
+      is_wild_disp = true;
+    } else {
+      uMON_OPTION_UINT(API, uint16_t, disp, 0, disp_tok, return false);
+      op.value = is_minus ? -disp : disp;
+    }
   }
 
   // Parse operand as char, number, or token
   bool is_string = tokens.is_string();
   auto op_str = tokens.next();
   uint16_t value;
-  if (is_string) {
+  if (strcmp(op_str, "*") == 0) {
+    uMON_FMT_ERROR(API, !is_pattern, "arg", op_str, return false);
+    op.token = TOK_WILDCARD;
+    op.value = TOK_UNDEFINED;
+  } else if (is_string) {
     uMON_FMT_ERROR(API, strlen(op_str) > 1, "chr", op_str, return false);
     op.token = TOK_IMMEDIATE;
     op.value = op_str[0];
@@ -49,26 +76,42 @@ bool parse_operand(Operand& op, uCLI::Tokens tokens) {
     op.token = TOK_IMMEDIATE;
     op.value = value;
   } else {
-    op.token = pgm_bsearch(TOK_STR, op_str);
+    op.token = pgm_hash_find<TokHash>(TOK_STR, op_str);
+    if (op.token == TOK_INVALID && symbol != nullptr && (isalpha(op_str[0]) || op_str[0] == '_')) {
+      op.token = TOK_IMMEDIATE;
+      op.value = 0;
+      *symbol = op_str;
+    }
     uMON_FMT_ERROR(API, op.token == TOK_INVALID, "arg", op_str, return false);
   }
 
+  // Match any displacement from base register
+  if (is_wild_disp) {
+    uMON_FMT_ERROR(API, op.token >= TOK_INVALID, "arg", op_str, return false);
+    op.value = op.token;
+    op.token = TOK_WILDCARD;
+  }
+
   if (is_indirect) {
     op.token |= TOK_INDIRECT;
   }
   return true;
 }
 
+// If symbols is provided, undefined names in operands are accepted and
+// recorded in the matching entry; other entries are left unchanged
+// If is_pattern is set, operands may be wildcards for find
 template <typename API>
-bool parse_instruction(Instruction& inst, uCLI::Tokens args) {
+bool parse_instruction(Instruction& inst, uCLI::Tokens args, const char** symbols = nullptr, bool is_pattern = false) {
   const char* mnemonic = args.next();
-  inst.mnemonic = pgm_bsearch(MNE_STR, mnemonic);
+  inst.mnemonic = pgm_hash_find<MneHash>(MNE_STR, mnemonic);
   uMON_FMT_ERROR(API, inst.mnemonic == MNE_INVALID, "op", mnemonic, return false);
 
   // Parse operands
-  for (Operand& op : inst.operands) {
+  for (uint8_t i = 0; i < MAX_OPERANDS; ++i) {
     if (!args.has_next()) break;
-    if (!parse_operand<API>(op, args.split_at(','))) return false;
+    const char** symbol = symbols != nullptr ? &symbols[i] : nullptr;
+    if (!parse_operand<API>(inst.operands[i], args.split_at(','), symbol, is_pattern)) return false;
   }
 
   // Error if unparsed operands remain
@@ -76,16 +119,369 @@ bool parse_instruction(Instruction& inst, uCLI::Tokens args) {
   return true;
 }
 
+// Stand-in that drops printed output, for errors the caller reports itself
 template <typename API>
+struct QuietAPI : API {
+  static void print_char(char) {}
+  static void print_string(const char*) {}
+  static void newline() {}
+};
+
+// Assembler stand-in that sizes instructions without writing them
+template <typename API>
+struct DryRunAPI : API {
+  static void write_bytes(uint16_t, const uint8_t*, uint8_t) {}
+};
+
+// Collects consecutive instructions into a block committed with one bulk write
+template <typename API, uint8_t N>
+struct BlockAPI : API {
+  static uint8_t buf[N];
+  static uint16_t base;
+  static uint8_t fill;
+
+  static void write_bytes(uint16_t addr, const uint8_t* data, uint8_t size) {
+    uint8_t i = addr - base;
+    memcpy(buf + i, data, size);
+    if (i + size > fill) fill = i + size;
+  }
+
+  // Commit block and start the next one where it ended
+  static void flush() {
+    API::write_bytes(base, buf, fill);
+    base += fill;
+    fill = 0;
+  }
+};
+
+template <typename API, uint8_t N> uint8_t BlockAPI<API, N>::buf[N];
+template <typename API, uint8_t N> uint16_t BlockAPI<API, N>::base;
+template <typename API, uint8_t N> uint8_t BlockAPI<API, N>::fill;
+
+// Cut source line at comment outside of quotes and trim spaces
+inline char* trim_source(char* line) {
+  char quote = '\0';
+  char* end = line;
+  for (; *end != '\0'; ++end) {
+    if (quote != '\0') {
+      if (*end == quote) quote = '\0';
+    } else if (*end == '"' || *end == '\'') {
+      quote = *end;
+    } else if (*end == ';') {
+      break;
+    }
+  }
+  while (end > line && end[-1] == ' ') --end;
+  *end = '\0';
+  while (*line == ' ') ++line;
+  return line;
+}
+
+// Split "name:" label definition from start of line, or return nullptr
+inline char* split_label(char*& line) {
+  char* colon = line;
+  while (isalnum(*colon) || *colon == '_') ++colon;
+  if (colon == line || *colon != ':') return nullptr;
+  *colon = '\0';
+  char* name = line;
+  line = colon + 1;
+  while (*line == ' ') ++line;
+  return name;
+}
+
+// Relax JP nn or JP cc,nn to JR if the target is within reach from addr
+// Only NZ/Z/NC/C have a JR form; returns true if relaxed
+inline bool relax_jump(Instruction& inst, uint16_t addr) {
+  if (inst.mnemonic != MNE_JP) return false;
+  const Operand& op1 = inst.operands[0];
+  const Operand& op2 = inst.operands[1];
+  uint16_t target;
+  if (op1.token == TOK_IMMEDIATE && op2.token == TOK_INVALID) {
+    target = op1.value;
+  } else if (token_to_cond(op1.token) < COND_PO && op2.token == TOK_IMMEDIATE) {
+    target = op2.value;
+  } else {
+    return false;
+  }
+  const int16_t disp = target - (addr + 2);
+  if (disp < -128 || disp > 127) return false;
+  inst.mnemonic = MNE_JR;
+  return true;
+}
+
+// Assemble source lines read from input until "." to consecutive addresses
+// Pass 1 sizes each line and defines labels, letting forward references stand
+// in for the instruction address; pass 2 re-parses the buffered source with
+// all labels defined and checks that every line assembles; pass 3 writes code
+// in blocks
+// If relax is set, JP is rewritten as JR in the buffered source wherever the
+// target is in reach, repeating until nothing more shrinks; code only ever
+// shrinks, so a jump in reach stays in reach
+// On error nothing is written and labels are put back as they were, and the
+// first line that failed is printed as "asm: line?"
+// Source is buffered in SRC_SIZE bytes on the stack, beside a LINE_SIZE line;
+// each line takes its length plus one and each label 5 more, so the default
+// holds about 15 lines
+// Returns address following the code written
+template <typename API, uint16_t SRC_SIZE = 256, uint8_t LINE_SIZE = 40, uint8_t BLOCK_SIZE = 32>
+uint16_t asm_batch(uint16_t start, bool relax = false) {
+  // Source lines fill from the front; for each label defined, a record of
+  // whether it existed, its old address and the offset of its line fills
+  // from the back
+  // Errors are reported once per batch as the failing line
+  using Quiet = QuietAPI<API>;
+  constexpr const uint8_t UNDO_SIZE = 5;
+  char source[SRC_SIZE];
+  uint16_t src_len = 0;
+  uint16_t undo = SRC_SIZE;
+  char buf[LINE_SIZE];
+  uint16_t addr = start;
+  bool is_ok = true;
+
+  // Put labels back as they were before the batch, most recent first
+  auto undo_labels = [&]() {
+    for (uint16_t r = undo; r < SRC_SIZE; r += UNDO_SIZE) {
+      const uint8_t* rec = (const uint8_t*)source + r;
+      strcpy(buf, source + (rec[3] | rec[4] << 8));
+      char* line = buf;
+      const char* label = split_label(line);
+      if (rec[0] != 0) {
+        API::get_labels().set_label(label, rec[1] | rec[2] << 8);
+      } else {
+        API::get_labels().remove_label(label);
+      }
+    }
+  };
+
+  for (;;) {
+    // Prompt with address of next instruction
+    API::print_char(' ');
+    format_hex16(API::print_char, addr);
+    API::print_string("  ");
+    input_line<API>(buf, sizeof(buf));
+    API::newline();
+    char* line = trim_source(buf);
+    if (strcmp(line, ".") == 0) break;
+    // Consume remaining source after an error
+    if (!is_ok || *line == '\0') continue;
+
+    // Keep a copy for later passes since parsing splits the line in place
+    const uint16_t len = strlen(line) + 1;
+    if (len + UNDO_SIZE > undo - src_len) {
+      API::print_string("full");
+      API::newline();
+      is_ok = false;
+      continue;
+    }
+    const uint16_t offset = src_len;
+    memcpy(source + src_len, line, len);
+    src_len += len;
+
+    const char* label = split_label(line);
+    if (label != nullptr) {
+      uint16_t old = 0;
+      const bool is_old = API::get_labels().get_addr(label, old);
+      undo -= UNDO_SIZE;
+      source[undo] = is_old;
+      source[undo + 1] = old & 0xFF;
+      source[undo + 2] = old >> 8;
+      source[undo + 3] = offset & 0xFF;
+      source[undo + 4] = offset >> 8;
+      if (!API::get_labels().set_label(label, addr)) {
+        API::print_string("full");
+        API::newline();
+        is_ok = false;
+        continue;
+      }
+    }
+    if (*line == '\0') continue;
+
+    Instruction inst;
+    const char* symbols[MAX_OPERANDS] = {};
+    uint8_t size = 0;
+    if (parse_instruction<Quiet>(inst, uCLI::Tokens(line), symbols)) {
+      for (uint8_t i = 0; i < MAX_OPERANDS; ++i) {
+        if (symbols[i] != nullptr) inst.operands[i].value = addr;
+      }
+      size = asm_instruction<DryRunAPI<Quiet>>(inst, addr);
+    }
+    uMON_FMT_ERROR(API, size == 0, "asm", source + offset, is_ok = false; continue);
+    addr += size;
+  }
+  if (!is_ok) {
+    undo_labels();
+    return start;
+  }
+
+  // Relax jumps with labels moved to where the previous pass left them
+  for (bool is_changed = relax; is_changed;) {
+    is_changed = false;
+    addr = start;
+    for (uint16_t i = 0; i < src_len; i += strlen(source + i) + 1) {
+      strcpy(buf, source + i);
+      char* line = buf;
+      const char* label = split_label(line);
+      if (label != nullptr) {
+        API::get_labels().set_label(label, addr);
+      }
+      if (*line == '\0') continue;
+      Instruction inst;
+      const char* symbols[MAX_OPERANDS] = {};
+      parse_instruction<API>(inst, uCLI::Tokens(line), symbols);
+      bool is_defined = true;
+      for (uint8_t j = 0; j < MAX_OPERANDS; ++j) {
+        if (symbols[j] != nullptr) {
+          inst.operands[j].value = addr;
+          is_defined = false;
+        }
+      }
+      if (is_defined && relax_jump(inst, addr)) {
+        // Rewrite JP as JR, keeping case
+        char& c = source[i + (line - buf) + 1];
+        c = (c & 0x20) | 'R';
+        is_changed = true;
+      }
+      addr += asm_instruction<DryRunAPI<API>>(inst, addr);
+    }
+  }
+
+  // Check that every line assembles at its final address before writing,
+  // catching names never defined and JR/DJNZ out of reach
+  addr = start;
+  for (uint16_t i = 0; i < src_len; i += strlen(source + i) + 1) {
+    const char* entry = source + i;
+    strcpy(buf, entry);
+    char* line = buf;
+    split_label(line);
+    if (*line == '\0') continue;
+    Instruction inst;
+    uint8_t size = 0;
+    if (parse_instruction<Quiet>(inst, uCLI::Tokens(line))) {
+      size = asm_instruction<DryRunAPI<Quiet>>(inst, addr);
+    }
+    uMON_FMT_ERROR(API, size == 0, "asm", entry, is_ok = false; break);
+    addr += size;
+  }
+  if (!is_ok) {
+    undo_labels();
+    return start;
+  }
+
+  // Write code with the same result as the check above
+  using Block = BlockAPI<API, BLOCK_SIZE>;
+  Block::base = start;
+  Block::fill = 0;
+  addr = start;
+  for (uint16_t i = 0; i < src_len; i += strlen(source + i) + 1) {
+    const char* entry = source + i;
+    strcpy(buf, entry);
+    char* line = buf;
+    const char* label = split_label(line);
+    if (label != nullptr) {
+      resolve_fixups<API>(label, addr);
+    }
+    if (*line == '\0') continue;
+    if (Block::fill > BLOCK_SIZE - MAX_INSTRUCTION_SIZE) {
+      Block::flush();
+    }
+    Instruction inst;
+    parse_instruction<API>(inst, uCLI::Tokens(line));
+    addr += asm_instruction<Block>(inst, addr);
+  }
+  Block::flush();
+  if (addr != start) {
+    API::get_fixups().discard(start, addr - 1);
+  }
+  return addr;
+}
+
+// Reads back the bytes staged by the last asm_instruction<DryRunAPI<API>>
+template <typename API>
+struct StagedAPI : API {
+  static uint8_t read_byte(uint16_t addr) {
+    using Stage = StageAPI<DryRunAPI<API>>;
+    return Stage::buf[uint8_t(addr - Stage::base) % MAX_INSTRUCTION_SIZE];
+  }
+};
+
+// Assemble instruction where an undefined name from parse_instruction stands
+// in as zero (or no displacement) until defined, then gets patched by fixup
+// The pending name is printed as "name?" so a typo does not pass unnoticed
+// Nothing is written on error
+// Returns size of instruction or 0 on error
+template <typename API>
+uint8_t asm_fixup(Instruction& inst, const char* const (&symbols)[MAX_OPERANDS], uint16_t addr) {
+  const bool is_rel = inst.mnemonic == MNE_JR || inst.mnemonic == MNE_DJNZ;
+  const char* symbol = nullptr;
+  for (uint8_t i = 0; i < MAX_OPERANDS; ++i) {
+    if (symbols[i] != nullptr) {
+      // Only one reference can be patched per instruction
+      uMON_FMT_ERROR(API, symbol != nullptr, "sym", symbols[i], return 0);
+      symbol = symbols[i];
+      inst.operands[i].value = is_rel ? addr + 2 : 0;
+    }
+  }
+  const uint8_t size = asm_instruction<DryRunAPI<API>>(inst, addr);
+  if (size == 0) return 0;
+
+  // Forget references into the code about to be overwritten
+  auto& fixups = API::get_fixups();
+  fixups.discard(addr, addr + size - 1);
+  if (symbol != nullptr) {
+    // Decode the staged code for the kind of immediate; it always ends the code
+    Instruction code;
+    dasm_instruction<StagedAPI<API>>(code, addr);
+    uint8_t kind = FIXUP_REL;
+    uint8_t width = is_rel ? 1 : 0;
+    for (const Operand& op : code.operands) {
+      if (is_rel || (op.token & TOK_MASK) != TOK_IMMEDIATE || (op.token & TOK_DIGIT) != 0) continue;
+      const bool is_byte = (op.token & TOK_BYTE) != 0;
+      kind = is_byte ? FIXUP_BYTE : FIXUP_WORD;
+      width = is_byte ? 1 : 2;
+    }
+    uMON_FMT_ERROR(API, width == 0 || size <= width, "sym", symbol, return 0);
+    if (!fixups.add(symbol, addr + size - width, kind)) {
+      API::print_string("full");
+      API::newline();
+      return 0;
+    }
+    API::print_string(symbol);
+    API::print_char('?');
+    API::newline();
+  }
+  API::write_bytes(addr, StageAPI<DryRunAPI<API>>::buf, size);
+  return size;
+}
+
+// Assemble one instruction at addr, or with no instruction given, a batch of
+// lines ended by "." (see asm_batch); the batch must fit in SRC_SIZE bytes of
+// stack, about 15 lines at the default 256
+// If RELAX is set, JP to a defined target in reach is assembled as JR, and
+// batch mode lists the code written for checking
+template <typename API, bool RELAX = false, uint16_t SRC_SIZE = 256>
 void cmd_asm(uCLI::Args args) {
   uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
 
-  // Parse and assemble instruction
+  // Read source lines until "." if no instruction given
+  if (!args.has_next()) {
+    const uint16_t end = asm_batch<API, SRC_SIZE>(start, RELAX);
+    if (RELAX && end != start) {
+      dasm_range<API>(start, end - 1);
+    }
+    set_prompt<API>(args.command(), end);
+    return;
+  }
+
+  // Parse and assemble instruction, deferring undefined names
   Instruction inst;
-  if (parse_instruction<API>(inst, args)) {
-    uint8_t size = asm_instruction<API>(inst, start);
+  const char* symbols[MAX_OPERANDS] = {};
+  if (parse_instruction<API>(inst, args, symbols)) {
+    if (RELAX && symbols[0] == nullptr && symbols[1] == nullptr) {
+      relax_jump(inst, start);
+    }
+    uint8_t size = asm_fixup<API>(inst, symbols, start);
     if (size > 0) {
-      set_prompt<API>(args.command(), start + size);
+      set_prompt<API>(args.command(), uint16_t(start + size));
     }
   }
 }
@@ -99,11 +495,129 @@ void cmd_dasm(uCLI::Args args) {
   uint16_t next = dasm_range<API, MAX_ROWS>(start, end_incl);
   uint16_t part = next - start;
   if (part < size) {
-    set_prompt<API>(args.command(), next, size - part);
+    set_prompt<API>(args.command(), next, uint16_t(size - part));
   } else {
     set_prompt<API>(args.command(), next);
   }
 }
 
+template <typename API, uint8_t MAX_ROWS = 24>
+void cmd_dasm_back(uCLI::Args args) {
+  // Default to one page of instructions preceding end
+  uMON_EXPECT_ADDR(API, uint16_t, end, args, return);
+  uMON_OPTION_UINT(API, uint8_t, rows, MAX_ROWS, args, return);
+  if (rows > MAX_ROWS) rows = MAX_ROWS;
+  uint16_t start = dasm_prev<API>(end, rows);
+  if (start != end) {
+    dasm_range<API, MAX_ROWS>(start, end - 1);
+  }
+  set_prompt<API>(args.command(), start);
+}
+
+template <typename API, uint8_t MAX_ROWS = 24>
+void cmd_find(uCLI::Args args) {
+  // Search size bytes from start for instructions matching pattern
+  uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
+  uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+  Instruction pattern;
+  if (!parse_instruction<API>(pattern, args, nullptr, true)) return;
+  uint16_t end_incl = start + size - 1;
+  uint16_t next = find_range<API, MAX_ROWS>(start, end_incl, pattern);
+  uint16_t part = next - start;
+  if (part < size) {
+    // Reprint pattern into prompt to resume search on the next command
+    set_prompt<API>(args.command(), next, uint16_t(size - part));
+    print_instruction<PromptAPI<API>>(pattern);
+  }
+}
+
+template <typename API>
+void cmd_reloc(uCLI::Args args) {
+  uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
+  uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+  uMON_EXPECT_ADDR(API, uint16_t, dest, args, return);
+  const uint16_t count = reloc_range<API>(start, start + size - 1, dest);
+  API::print_string("patched: $");
+  format_hex16(API::print_char, count);
+  API::newline();
+}
+
+template <typename API>
+void cmd_stack(uCLI::Args args) {
+  // Print maximum stack depth for each entry point
+  StackAnalyzer<API> analyzer;
+  do {
+    uMON_EXPECT_ADDR(API, uint16_t, entry, args, return);
+    StackResult result = analyzer.analyze(entry);
+    Operand op(TOK_IMMEDIATE, entry);
+    print_operand<API>(op);
+    API::print_string(": $");
+    format_hex16(API::print_char, result.depth);
+    if (result.flags != 0) {
+      if (result.flags & STACK_RECURSION) API::print_string(" recursion");
+      if (result.flags & STACK_INDIRECT) API::print_string(" indirect");
+      if (result.flags & STACK_SP_LOAD) API::print_string(" sp");
+      if (result.flags & STACK_UNBALANCED) API::print_string(" unbalanced");
+      if (result.flags & STACK_LIMIT) API::print_string(" limit");
+      API::print_string(" at $");
+      format_hex16(API::print_char, result.flag_addr);
+    }
+    API::newline();
+  } while (args.has_next());
+}
+
+template <typename API>
+void cmd_stats(uCLI::Args args) {
+  // Tally whole address space if range not provided
+  uint16_t start = 0;
+  uint16_t end_incl = 0xFFFF;
+  if (args.has_next()) {
+    uMON_EXPECT_ADDR(API, uint16_t, addr, args, return);
+    uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+    start = addr;
+    end_incl = addr + size - 1;
+  }
+  OpcodeStats<API> stats;
+  stats.add(start, end_incl);
+
+  // Print instruction and byte counts, most frequent first
+  uint8_t order[MNE_INVALID + 1];
+  const uint8_t n = stats.sort(order);
+  for (uint8_t i = 0; i < n; ++i) {
+    const uint8_t mnemonic = order[i];
+    char name[6];
+    FormatBuffer out(name, sizeof(name));
+    if (mnemonic < MNE_INVALID) {
+      out.print_pgm_table(MNE_STR, mnemonic);
+    } else {
+      out('?');
+    }
+    while (out.finish() < sizeof(name) - 1) out(' ');
+    API::print_string(name);
+    API::print_char('$');
+    format_hex16(API::print_char, stats.count(mnemonic));
+    API::print_string(" $");
+    format_hex16(API::print_char, stats.bytes(mnemonic));
+    API::newline();
+  }
+
+  // Print count of each prefix byte
+  static const uint8_t PREFIXES[STATS_PREFIXES] = { PREFIX_IX, PREFIX_IY, PREFIX_ED, PREFIX_CB };
+  for (uint8_t i = 0; i < STATS_PREFIXES; ++i) {
+    if (stats.prefix(i) == 0) continue;
+    API::print_char('$');
+    format_hex8(API::print_char, PREFIXES[i]);
+    API::print_string("  $");
+    format_hex16(API::print_char, stats.prefix(i));
+    API::newline();
+  }
+
+  API::print_string("total $");
+  format_hex32(API::print_char, stats.total_count());
+  API::print_string(" $");
+  format_hex32(API::print_char, stats.total_bytes());
+  API::newline();
+}
+
 } // namespace z80
 } // namespace uMon
@@ -256,7 +256,7 @@ uint8_t write_dec(uint16_t addr, Operand& op) {
 // Write EX instruction at address
 template <typename API>
 uint8_t write_ex(uint16_t addr, Operand& op1, Operand& op2) {
-  // EX (SP),HL
+  // EX (SP),HL/IX/IY; EX AF,AF and EX DE,HL are in fixed.def
   if (op1.token == (TOK_SP | TOK_INDIRECT)) {
     uint8_t prefix = token_to_prefix(op2.token);
     if (token_to_pair(op2.token, prefix) != PAIR_HL) {
@@ -264,12 +264,6 @@ uint8_t write_ex(uint16_t addr, Operand& op1, Operand& op2) {
       return 0;
     }
     return write_pfx_code<API>(addr, prefix, 0xE3);
-  // EX DE,HL
-  } else if (op1.token == TOK_DE && op2.token == TOK_HL) {
-    return write_code<API>(addr, 0xEB);
-  // EX AF,AF
-  } else if (op1.token == TOK_AF && (op2.token == TOK_AF || op2.token == TOK_INVALID)) {
-    return write_code<API>(addr, 0x08);
   // ?
   } else {
     print_operand_error<API>(op1);
@@ -376,36 +370,14 @@ uint8_t write_jr(uint16_t addr, Operand& op1, Operand& op2) {
 // Write LD instruction at address
 template <typename API>
 uint8_t write_ld(uint16_t addr, Operand& dst, Operand& src) {
-  // Special cases for destination A
-  if (dst.token == TOK_A) {
-    switch (src.token) {
-    case TOK_I: // LD A,I
-      return write_pfx_code<API>(addr, PREFIX_ED, 0x57);
-    case TOK_R: // LD A,R
-      return write_pfx_code<API>(addr, PREFIX_ED, 0x5F);
-    case TOK_BC_IND: // LD A,(BC)
-      return write_code<API>(addr, 0x0A);
-    case TOK_DE_IND: // LD A,(DE)
-      return write_code<API>(addr, 0x1A);
-    case TOK_IMM_IND: // LD A,(nn)
-      return write_code_word<API>(addr, 0x3A, src.value);
-    }
+  // LD A,(BC) and the like are in fixed.def
+  // LD A,(nn)
+  if (dst.token == TOK_A && src.token == TOK_IMM_IND) {
+    return write_code_word<API>(addr, 0x3A, src.value);
   }
-
-  // Special cases for source A
-  if (src.token == TOK_A) {
-    switch (dst.token) {
-    case TOK_I: // LD I,A
-      return write_pfx_code<API>(addr, PREFIX_ED, 0x47);
-    case TOK_R: // LD R,A
-      return write_pfx_code<API>(addr, PREFIX_ED, 0x4F);
-    case TOK_BC_IND: // LD (BC),A
-      return write_code<API>(addr, 0x02);
-    case TOK_DE_IND: // LD (DE),A
-      return write_code<API>(addr, 0x12);
-    case TOK_IMM_IND: // LD (nn),A
-      return write_code_word<API>(addr, 0x32, dst.value);
-    }
+  // LD (nn),A
+  if (dst.token == TOK_IMM_IND && src.token == TOK_A) {
+    return write_code_word<API>(addr, 0x32, dst.value);
   }
 
   // Special cases for destination HL/IX/IY
@@ -506,18 +478,13 @@ uint8_t write_pop(uint16_t addr, Operand& op) {
 // Write RET instruction at address
 template <typename API>
 uint8_t write_ret(uint16_t addr, Operand& op) {
-  // RET
-  if (op.token == TOK_INVALID) {
-    return write_code<API>(addr, 0xC9);
-  // RET cc
-  } else {
-    uint8_t cond = token_to_cond(op.token);
-    if (cond == COND_INVALID) {
-      print_operand_error<API>(op);
-      return 0;
-    }
-    return write_code<API>(addr, 0300 | cond << 3);
+  // RET cc; plain RET is in fixed.def
+  uint8_t cond = token_to_cond(op.token);
+  if (cond == COND_INVALID) {
+    print_operand_error<API>(op);
+    return 0;
   }
+  return write_code<API>(addr, 0300 | cond << 3);
 }
 
 // Write RST instruction at address
@@ -531,10 +498,41 @@ uint8_t write_rst(uint16_t addr, Operand& op) {
   }
 }
 
+// Write DB bytes or DW little-endian words given as up to two immediates
+// This is not the dasm_data format; see there
 template <typename API>
-uint8_t asm_instruction(Instruction& inst, uint16_t addr) {
+uint8_t write_data(uint16_t addr, Operand (&ops)[MAX_OPERANDS], bool is_word) {
+  uint8_t size = 0;
+  for (Operand& op : ops) {
+    if (op.token == TOK_INVALID && size > 0) break;
+    if (op.token != TOK_IMMEDIATE || (!is_word && op.value > 0xFF)) {
+      print_operand_error<API>(op);
+      return 0;
+    }
+    API::write_byte(addr + size++, op.value & 0xFF);
+    if (is_word) {
+      API::write_byte(addr + size++, op.value >> 8);
+    }
+  }
+  return size;
+}
+
+// Encode instruction at address through API::write_byte
+// Returns size of instruction or 0 on error, possibly after partial writes
+template <typename API>
+uint8_t encode_instruction(Instruction& inst, uint16_t addr) {
   Operand& op1 = inst.operands[0];
   Operand& op2 = inst.operands[1];
+  // Forms listed in fixed.def are encoded from the table
+  const uint8_t first = inst.mnemonic < MNE_INVALID
+    ? pgm_read_byte((const char*)&FixedFirst<>::table[inst.mnemonic]) : N_FIXED;
+  for (uint8_t i = first; i < N_FIXED; ++i) {
+    const Fixed entry = read_fixed(i);
+    if (entry.mnemonic != inst.mnemonic) break;
+    if (op1.token == entry.op1 && op2.token == entry.op2) {
+      return write_pfx_code<API>(addr, entry.prefix, entry.code);
+    }
+  }
   switch (inst.mnemonic) {
   case MNE_ADC:
     return write_alu<API>(addr, ALU_ADC, op1, op2);
@@ -546,80 +544,34 @@ uint8_t asm_instruction(Instruction& inst, uint16_t addr) {
     return write_cb_bit<API>(addr, CB_BIT, op1, op2);
   case MNE_CALL:
     return write_call<API>(addr, op1, op2);
-  case MNE_CCF:
-    return write_code<API>(addr, 0x3F);
   case MNE_CP:
     return write_alu<API>(addr, ALU_CP, op1, op2);
-  case MNE_CPD:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA9);
-  case MNE_CPDR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB9);
-  case MNE_CPI:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA1);
-  case MNE_CPIR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB1);
-  case MNE_CPL:
-    return write_code<API>(addr, 0x2F);
-  case MNE_DAA:
-    return write_code<API>(addr, 0x27);
+  case MNE_DB:
+    return write_data<API>(addr, inst.operands, false);
   case MNE_DEC:
     return write_dec<API>(addr, op1);
-  case MNE_DI:
-    return write_code<API>(addr, 0xF3);
   case MNE_DJNZ:
     return write_djnz<API>(addr, op1);
-  case MNE_EI:
-    return write_code<API>(addr, 0xFB);
+  case MNE_DW:
+    return write_data<API>(addr, inst.operands, true);
   case MNE_EX:
     return write_ex<API>(addr, op1, op2);
-  case MNE_EXX:
-    return write_code<API>(addr, 0xD9);
-  case MNE_HALT:
-    return write_code<API>(addr, 0x76);
   case MNE_IM:
     return write_im<API>(addr, op1);
   case MNE_IN:
     return write_in<API>(addr, op1, op2);
   case MNE_INC:
     return write_inc<API>(addr, op1);
-  case MNE_IND:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xAA);
-  case MNE_INDR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xBA);
-  case MNE_INI:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA2);
-  case MNE_INIR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB2);
   case MNE_JP:
     return write_jp<API>(addr, op1, op2);
   case MNE_JR:
     return write_jr<API>(addr, op1, op2);
   case MNE_LD:
     return write_ld<API>(addr, op1, op2);
-  case MNE_LDD:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA8);
-  case MNE_LDDR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB8);
-  case MNE_LDI:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA0);
-  case MNE_LDIR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB0);
-  case MNE_NEG:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0x44);
-  case MNE_NOP:
-    return write_code<API>(addr, 0x00);
   case MNE_OR:
     return write_alu<API>(addr, ALU_OR, op1, op2);
-  case MNE_OTDR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xBB);
-  case MNE_OTIR:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xB3);
   case MNE_OUT:
     return write_out<API>(addr, op1, op2);
-  case MNE_OUTD:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xAB);
-  case MNE_OUTI:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0xA3);
   case MNE_POP:
     return write_pop<API>(addr, op1);
   case MNE_PUSH:
@@ -628,36 +580,18 @@ uint8_t asm_instruction(Instruction& inst, uint16_t addr) {
     return write_cb_bit<API>(addr, CB_RES, op1, op2);
   case MNE_RET:
     return write_ret<API>(addr, op1);
-  case MNE_RETI:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0x4D);
-  case MNE_RETN:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0x45);
   case MNE_RL:
     return write_cb_rot<API>(addr, ROT_RL, op1);
-  case MNE_RLA:
-    return write_code<API>(addr, 0x17);
   case MNE_RLC:
     return write_cb_rot<API>(addr, ROT_RLC, op1);
-  case MNE_RLCA:
-    return write_code<API>(addr, 0x07);
-  case MNE_RLD:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0x6F);
   case MNE_RR:
     return write_cb_rot<API>(addr, ROT_RR, op1);
-  case MNE_RRA:
-    return write_code<API>(addr, 0x1F);
   case MNE_RRC:
     return write_cb_rot<API>(addr, ROT_RRC, op1);
-  case MNE_RRCA:
-    return write_code<API>(addr, 0x0F);
-  case MNE_RRD:
-    return write_pfx_code<API>(addr, PREFIX_ED, 0x67);
   case MNE_RST:
     return write_rst<API>(addr, op1);
   case MNE_SBC:
     return write_alu<API>(addr, ALU_SBC, op1, op2);
-  case MNE_SCF:
-    return write_code<API>(addr, 0x37);
   case MNE_SET:
     return write_cb_bit<API>(addr, CB_SET, op1, op2);
   case MNE_SL1:
@@ -673,8 +607,49 @@ uint8_t asm_instruction(Instruction& inst, uint16_t addr) {
   case MNE_XOR:
     return write_alu<API>(addr, ALU_XOR, op1, op2);
   }
+  // Mnemonic has only fixed forms and none matched
+  if (first < N_FIXED) {
+    print_operand_error<API>(op1);
+    return 0;
+  }
+  // DS is only printed by the disassembler; runs can be set with fill
+  API::print_string("op: ");
+  print_pgm_table<API>(MNE_STR, inst.mnemonic);
+  API::print_char('?');
+  API::newline();
   return 0;
 }
 
+// Longest Z80 encoding, as in DD CB d op
+constexpr const uint8_t MAX_INSTRUCTION_SIZE = 4;
+
+// Collects the bytes of one instruction for asm_instruction
+template <typename API>
+struct StageAPI : API {
+  static uint8_t buf[MAX_INSTRUCTION_SIZE];
+  static uint16_t base;
+
+  static void write_byte(uint16_t addr, uint8_t data) {
+    buf[uint8_t(addr - base) % MAX_INSTRUCTION_SIZE] = data;
+  }
+};
+
+template <typename API> uint8_t StageAPI<API>::buf[MAX_INSTRUCTION_SIZE];
+template <typename API> uint16_t StageAPI<API>::base;
+
+// Assemble instruction and commit it with one API::write_bytes
+// Nothing is written on error
+// Returns size of instruction or 0 on error
+template <typename API>
+uint8_t asm_instruction(Instruction& inst, uint16_t addr) {
+  using Stage = StageAPI<API>;
+  Stage::base = addr;
+  const uint8_t size = encode_instruction<Stage>(inst, addr);
+  if (size > 0) {
+    API::write_bytes(addr, Stage::buf, size);
+  }
+  return size;
+}
+
 } // namespace z80
 } // namespace uMon
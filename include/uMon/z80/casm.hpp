@@ -0,0 +1,477 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Compile-time assembler for embedding Z80 routines in firmware
+// Source is one instruction per line with optional "name:" labels and ';'
+// comments, as in asm_batch; operands are written as for parse_operand
+// Mistakes fail compilation with a call to one of the error_* functions
+//
+//   uMON_Z80_ASM(Beep, 0x8000,
+//     "      LD B,16\n"
+//     "loop: LD A,$10\n"
+//     "      OUT ($FE),A\n"
+//     "      DJNZ loop\n"
+//     "      RET");
+//
+// Beep::code is a PROGMEM array of Beep::SIZE bytes assembled for Beep::ORG
+
+#pragma once
+
+#include "uMon/z80/asm.hpp"
+#include "uMon/hash.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+namespace casm {
+
+struct Encoding {
+  uint8_t size;
+  uint8_t bytes[MAX_INSTRUCTION_SIZE];
+};
+
+// Never defined; reaching one while assembling names the problem in the
+// compiler error
+uint16_t error_bad_number();
+Operand error_bad_operand();
+uint16_t error_undefined_label();
+uint8_t error_mixed_index();
+uint8_t error_jump_too_far();
+Encoding error_bad_mnemonic();
+Encoding error_bad_operands();
+uint8_t error_bad_size();
+
+// ============================================================================
+// Source Scanning
+// ============================================================================
+
+constexpr bool is_eol(char c) { return c == '\0' || c == '\n' || c == ';'; }
+constexpr bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+constexpr bool is_word(char c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_';
+}
+
+constexpr const char* skip_space(const char* s) { return is_space(*s) ? skip_space(s + 1) : s; }
+constexpr const char* skip_word(const char* s) { return is_word(*s) ? skip_word(s + 1) : s; }
+
+constexpr const char* trim_end(const char* s, const char* e) {
+  return e > s && is_space(e[-1]) ? trim_end(s, e - 1) : e;
+}
+
+constexpr const char* next_line(const char* s) {
+  return *s == '\0' ? s : *s == '\n' ? s + 1 : next_line(s + 1);
+}
+
+// End of operand at ',' or end of line, stepping over quoted chars
+constexpr const char* field_end(const char* s) {
+  return *s == '\'' && s[1] != '\0' && s[2] == '\'' ? field_end(s + 3)
+    : is_eol(*s) || *s == ',' ? s
+    : field_end(s + 1);
+}
+
+// Start of instruction following optional "name:" label
+constexpr const char* skip_label(const char* s) {
+  return skip_word(s) != s && *skip_word(s) == ':' ? skip_space(skip_word(s) + 1) : s;
+}
+
+// Match [a, a_end) with [b, b_end)
+constexpr bool range_equal(const char* a, const char* a_end, const char* b, const char* b_end) {
+  return a == a_end || b == b_end ? a == a_end && b == b_end
+    : *a == *b && range_equal(a + 1, a_end, b + 1, b_end);
+}
+
+// Match null-terminated name with [s, e), folding case as strcasecmp
+constexpr bool name_equal(const char* name, const char* s, const char* e) {
+  return s == e ? *name == '\0'
+    : *name != '\0' && (*name | 0x20) == (*s | 0x20) && name_equal(name + 1, s + 1, e);
+}
+
+// Index of [s, e) in table of names, or N if none
+template <uint8_t N>
+constexpr uint8_t find_name(const char* const (&names)[N], const char* s, const char* e, uint8_t i = 0) {
+  return i == N ? N : name_equal(names[i], s, e) ? i : find_name(names, s, e, i + 1);
+}
+
+// Index of value in table, or N if none
+template <uint8_t N>
+constexpr uint8_t find_value(const uint8_t (&table)[N], uint8_t value, uint8_t i = 0) {
+  return i == N ? N : table[i] == value ? i : find_value(table, value, i + 1);
+}
+
+// ============================================================================
+// Operand Parsing
+// ============================================================================
+
+constexpr uint8_t digit_value(char c) {
+  return c >= '0' && c <= '9' ? c - '0'
+    : (c | 0x20) >= 'a' && (c | 0x20) <= 'z' ? (c | 0x20) - 'a' + 10
+    : 0xFF;
+}
+
+constexpr uint16_t parse_digits(const char* s, const char* e, uint8_t base, uint16_t value = 0) {
+  return s == e ? value
+    : digit_value(*s) < base ? parse_digits(s + 1, e, base, value * base + digit_value(*s))
+    : error_bad_number();
+}
+
+// Parse number with $ for hex, & for octal, and % for binary as parse_unsigned
+constexpr uint16_t parse_number(const char* s, const char* e) {
+  return s == e ? error_bad_number()
+    : *s == '$' ? (s + 1 == e ? error_bad_number() : parse_digits(s + 1, e, 16))
+    : *s == '&' ? (s + 1 == e ? error_bad_number() : parse_digits(s + 1, e, 8))
+    : *s == '%' ? (s + 1 == e ? error_bad_number() : parse_digits(s + 1, e, 2))
+    : parse_digits(s, e, 10);
+}
+
+constexpr Encoding encode_line(const char* line, const char* source, uint16_t org, uint16_t addr);
+
+// Address of label [s, e) defined in source
+constexpr uint16_t label_addr(const char* line, uint16_t addr, const char* s, const char* e) {
+  return *line == '\0' ? error_undefined_label()
+    : *skip_word(skip_space(line)) == ':'
+      && range_equal(skip_space(line), skip_word(skip_space(line)), s, e) ? addr
+    // Size lines with labels standing in as the instruction address
+    : label_addr(next_line(line), addr + encode_line(line, nullptr, 0, addr).size, s, e);
+}
+
+// Token if [s, e) names one, otherwise label value
+// Labels are the instruction address while sizing, when source is null
+constexpr Operand parse_name(uint8_t token, const char* s, const char* e,
+    const char* source, uint16_t org, uint16_t addr) {
+  return token != TOK_UNDEFINED && token < TOK_INVALID ? Operand(token)
+    : Operand(TOK_IMMEDIATE, source == nullptr ? addr : label_addr(source, org, s, e));
+}
+
+// Parse char, number, token, or label from trimmed [s, e)
+constexpr Operand parse_value(const char* s, const char* e, const char* source, uint16_t org, uint16_t addr) {
+  return *s == '\'' ? (e == s + 3 && s[2] == '\'' ? Operand(TOK_IMMEDIATE, uint8_t(s[1])) : error_bad_operand())
+    : *s == '$' || *s == '&' || *s == '%' || (*s >= '0' && *s <= '9') ? Operand(TOK_IMMEDIATE, parse_number(s, e))
+    : s != e && skip_word(s) == e ? parse_name(find_name(TOK_NAMES, s, e), s, e, source, org, addr)
+    : error_bad_operand();
+}
+
+constexpr Operand with_disp(Operand base, uint16_t disp) {
+  return base.token < TOK_INVALID ? Operand(base.token, disp) : error_bad_operand();
+}
+
+// Parse inside of parentheses, with +/- displacement following a register
+constexpr Operand parse_inner(const char* s, const char* w, const char* e,
+    const char* source, uint16_t org, uint16_t addr) {
+  return w != s && (*w == '+' || *w == '-')
+    ? with_disp(parse_value(s, trim_end(s, w), source, org, addr),
+      *w == '+' ? parse_number(skip_space(w + 1), e) : -parse_number(skip_space(w + 1), e))
+    : parse_value(s, e, source, org, addr);
+}
+
+constexpr Operand indirect(Operand op) {
+  return Operand(op.token | TOK_INDIRECT, op.value);
+}
+
+// Parse operand from trimmed [s, e), or TOK_INVALID if empty
+constexpr Operand parse_trimmed(const char* s, const char* e, const char* source, uint16_t org, uint16_t addr) {
+  return s == e ? Operand()
+    : *s == '(' && e[-1] == ')'
+      ? indirect(parse_inner(skip_space(s + 1), skip_space(skip_word(skip_space(s + 1))),
+        trim_end(s + 1, e - 1), source, org, addr))
+    : parse_value(s, e, source, org, addr);
+}
+
+constexpr Operand parse_field(const char* s, const char* e, const char* source, uint16_t org, uint16_t addr) {
+  return parse_trimmed(skip_space(s), trim_end(skip_space(s), e), source, org, addr);
+}
+
+// ============================================================================
+// Operand Encodings
+// ============================================================================
+
+constexpr bool is_none(Operand op) { return op.token == TOK_INVALID; }
+constexpr bool is_imm(Operand op) { return op.token == TOK_IMMEDIATE; }
+
+// True for (HL), (IX+d), and (IY+d)
+constexpr bool is_mem(Operand op) {
+  return op.token == TOK_HL_IND || op.token == TOK_IX_IND || op.token == TOK_IY_IND;
+}
+
+// Constant version of token_to_prefix
+constexpr uint8_t index_prefix(uint8_t token) {
+  return (token & TOK_MASK) == TOK_IX || (token & TOK_MASK) == TOK_IXH || (token & TOK_MASK) == TOK_IXL ? PREFIX_IX
+    : (token & TOK_MASK) == TOK_IY || (token & TOK_MASK) == TOK_IYH || (token & TOK_MASK) == TOK_IYL ? PREFIX_IY
+    : 0;
+}
+
+// IX/IY prefix shared by both operands
+constexpr uint8_t op_prefix(uint8_t p1, uint8_t p2) {
+  return p1 == 0 || p1 == p2 ? p2 : p2 == 0 ? p1 : error_mixed_index();
+}
+
+// Constant version of token_to_reg
+constexpr uint8_t reg(Operand op, uint8_t prefix) {
+  return prefix == PREFIX_IX ? find_value(REG_TOK_IX, op.token)
+    : prefix == PREFIX_IY ? find_value(REG_TOK_IY, op.token)
+    : find_value(REG_TOK, op.token);
+}
+
+// Register paired with (IX+d) is never IXH/IXL
+constexpr uint8_t reg_with(Operand op, uint8_t prefix, Operand other) {
+  return reg(op, is_mem(other) ? 0 : prefix);
+}
+
+// Constant version of token_to_pair
+constexpr uint8_t pair(Operand op, uint8_t prefix, bool use_af = false) {
+  return op.token == (prefix == PREFIX_IX ? TOK_IX : prefix == PREFIX_IY ? TOK_IY : TOK_HL) ? uint8_t(PAIR_HL)
+    : op.token == TOK_HL || op.token == TOK_IX || op.token == TOK_IY ? uint8_t(PAIR_INVALID)
+    : use_af && op.token == TOK_AF ? uint8_t(PAIR_SP)
+    : use_af && op.token == TOK_SP ? uint8_t(PAIR_INVALID)
+    : find_value(PAIR_TOK, op.token);
+}
+
+constexpr uint8_t cond(Operand op) { return find_value(COND_TOK, op.token); }
+
+// JR/DJNZ displacement from instruction at addr to target
+constexpr uint8_t rel(uint16_t target, uint16_t addr) {
+  return int16_t(target - addr - 2) >= -128 && int16_t(target - addr - 2) <= 127
+    ? uint8_t(target - addr - 2) : error_jump_too_far();
+}
+
+// ============================================================================
+// Instruction Encodings
+// ============================================================================
+
+// [(prefix,) code] followed by n bytes of data, least significant first
+constexpr Encoding emit(uint8_t prefix, uint8_t code, uint8_t n = 0, uint16_t data = 0) {
+  return prefix != 0
+    ? Encoding{uint8_t(2 + n), {prefix, code, uint8_t(data), uint8_t(data >> 8)}}
+    : Encoding{uint8_t(1 + n), {code, uint8_t(data), uint8_t(data >> 8), 0}};
+}
+
+// As emit, inserting the displacement of (IX+d) before data
+constexpr Encoding emit_mem(uint8_t prefix, uint8_t code, Operand mem, uint8_t n = 0, uint8_t data = 0) {
+  return prefix != 0 && is_mem(mem)
+    ? emit(prefix, code, n + 1, uint8_t(mem.value) | data << 8)
+    : emit(prefix, code, n, data);
+}
+
+// [(prefix,) CB, (d,) code]
+constexpr Encoding emit_cb(uint8_t prefix, uint8_t code, Operand op) {
+  return reg(op, prefix) == REG_INVALID || (prefix != 0 && !is_mem(op)) ? error_bad_operands()
+    : prefix != 0 ? Encoding{4, {prefix, PREFIX_CB, uint8_t(op.value), uint8_t(code | reg(op, prefix))}}
+    : Encoding{2, {PREFIX_CB, uint8_t(code | reg(op, prefix))}};
+}
+
+constexpr Encoding encode_ld(Operand dst, Operand src, uint8_t p) {
+  return reg_with(dst, p, src) < REG_INVALID && reg_with(src, p, dst) < REG_INVALID
+      ? (is_mem(dst) && is_mem(src) ? error_bad_operands()
+        : emit_mem(p, 0100 | reg_with(dst, p, src) << 3 | reg_with(src, p, dst), is_mem(dst) ? dst : src))
+    : reg(dst, p) < REG_INVALID && is_imm(src) ? emit_mem(p, 0006 | reg(dst, p) << 3, dst, 1, src.value)
+    : pair(dst, p) < PAIR_INVALID && is_imm(src) ? emit(p, 0001 | pair(dst, p) << 4, 2, src.value)
+    : pair(dst, p) == PAIR_HL && src.token == TOK_IMM_IND ? emit(p, 0052, 2, src.value)
+    : dst.token == TOK_IMM_IND && pair(src, p) == PAIR_HL ? emit(p, 0042, 2, dst.value)
+    : p == 0 && pair(dst, 0) < PAIR_INVALID && src.token == TOK_IMM_IND
+      ? emit(PREFIX_ED, 0113 | pair(dst, 0) << 4, 2, src.value)
+    : p == 0 && dst.token == TOK_IMM_IND && pair(src, 0) < PAIR_INVALID
+      ? emit(PREFIX_ED, 0103 | pair(src, 0) << 4, 2, dst.value)
+    : dst.token == TOK_A && src.token == TOK_IMM_IND ? emit(0, 0072, 2, src.value)
+    : dst.token == TOK_IMM_IND && src.token == TOK_A ? emit(0, 0062, 2, dst.value)
+    : dst.token == TOK_SP && pair(src, p) == PAIR_HL ? emit(p, 0371)
+    : error_bad_operands();
+}
+
+// 8-bit ALU op on A from register, (HL), (IX+d), or immediate
+constexpr Encoding encode_alu_a(uint8_t alu, Operand src, uint8_t p) {
+  return reg(src, p) < REG_INVALID ? emit_mem(p, 0200 | alu << 3 | reg(src, p), src)
+    : is_imm(src) ? emit(0, 0306 | alu << 3, 1, src.value)
+    : error_bad_operands();
+}
+
+// ALU op as "op A,src" or "op src", or 16-bit ADD/ADC/SBC to HL/IX/IY
+constexpr Encoding encode_alu(uint8_t alu, Operand op1, Operand op2, uint8_t p) {
+  return pair(op1, p) == PAIR_HL && pair(op2, p) < PAIR_INVALID
+      ? (alu == ALU_ADD ? emit(p, 0011 | pair(op2, p) << 4)
+        : alu == ALU_ADC && p == 0 ? emit(PREFIX_ED, 0112 | pair(op2, p) << 4)
+        : alu == ALU_SBC && p == 0 ? emit(PREFIX_ED, 0102 | pair(op2, p) << 4)
+        : error_bad_operands())
+    : is_none(op2) ? encode_alu_a(alu, op1, p)
+    : op1.token == TOK_A ? encode_alu_a(alu, op2, p)
+    : error_bad_operands();
+}
+
+constexpr Encoding encode_inc_dec(uint8_t code_r, uint8_t code_rr, Operand op1, Operand op2, uint8_t p) {
+  return !is_none(op2) ? error_bad_operands()
+    : reg(op1, p) < REG_INVALID ? emit_mem(p, code_r | reg(op1, p) << 3, op1)
+    : pair(op1, p) < PAIR_INVALID ? emit(p, code_rr | pair(op1, p) << 4)
+    : error_bad_operands();
+}
+
+// JP/CALL to immediate, optionally on condition
+constexpr Encoding encode_call_jp(uint8_t code, uint8_t code_cc, Operand op1, Operand op2) {
+  return is_imm(op1) && is_none(op2) ? emit(0, code, 2, op1.value)
+    : cond(op1) < COND_INVALID && is_imm(op2) ? emit(0, code_cc | cond(op1) << 3, 2, op2.value)
+    : error_bad_operands();
+}
+
+// JR/DJNZ to immediate, optionally on condition NZ/Z/NC/C
+constexpr Encoding encode_jr(uint8_t code, Operand op1, Operand op2, uint16_t addr) {
+  return is_imm(op1) && is_none(op2) ? emit(0, code, 1, rel(op1.value, addr))
+    : code == 0030 && cond(op1) < COND_PO && is_imm(op2)
+      ? emit(0, 0040 | cond(op1) << 3, 1, rel(op2.value, addr))
+    : error_bad_operands();
+}
+
+constexpr Encoding encode_push_pop(uint8_t code, Operand op1, Operand op2, uint8_t p) {
+  return is_none(op2) && pair(op1, p, true) < PAIR_INVALID ? emit(p, code | pair(op1, p, true) << 4)
+    : error_bad_operands();
+}
+
+constexpr Encoding encode_ex(Operand op1, Operand op2, uint8_t p) {
+  return op1.token == TOK_SP_IND && pair(op2, p) == PAIR_HL ? emit(p, 0343)
+    : error_bad_operands();
+}
+
+constexpr Encoding encode_in(Operand data, Operand port) {
+  return data.token == TOK_A && port.token == TOK_IMM_IND ? emit(0, 0333, 1, port.value)
+    : port.token == (TOK_C | TOK_INDIRECT) && !is_mem(data) && reg(data, 0) < REG_INVALID
+      ? emit(PREFIX_ED, 0100 | reg(data, 0) << 3)
+    : error_bad_operands();
+}
+
+constexpr Encoding encode_out(Operand port, Operand data) {
+  return port.token == TOK_IMM_IND && data.token == TOK_A ? emit(0, 0323, 1, port.value)
+    : port.token == (TOK_C | TOK_INDIRECT) && !is_mem(data) && reg(data, 0) < REG_INVALID
+      ? emit(PREFIX_ED, 0101 | reg(data, 0) << 3)
+    : error_bad_operands();
+}
+
+// Forms listed in fixed.def, from fixed_code
+constexpr Encoding encode_fixed(uint16_t code) {
+  return emit(code >> 8, code & 0xFF);
+}
+
+// Constant version of asm_instruction
+constexpr Encoding encode(uint8_t mne, Operand op1, Operand op2, uint8_t p, uint16_t addr) {
+  return fixed_code(mne, op1.token, op2.token) != FIXED_NONE
+      ? encode_fixed(fixed_code(mne, op1.token, op2.token))
+    : mne == MNE_LD ? encode_ld(op1, op2, p)
+    : find_value(ALU_MNE, mne) < sizeof(ALU_MNE) ? encode_alu(find_value(ALU_MNE, mne), op1, op2, p)
+    : mne == MNE_INC ? encode_inc_dec(0004, 0003, op1, op2, p)
+    : mne == MNE_DEC ? encode_inc_dec(0005, 0013, op1, op2, p)
+    : mne == MNE_JP && is_mem(op1) && op1.value == 0 && is_none(op2) ? emit(p, 0351)
+    : mne == MNE_JP ? encode_call_jp(0303, 0302, op1, op2)
+    : mne == MNE_CALL ? encode_call_jp(0315, 0304, op1, op2)
+    : mne == MNE_RET && cond(op1) < COND_INVALID && is_none(op2) ? emit(0, 0300 | cond(op1) << 3)
+    : mne == MNE_JR ? encode_jr(0030, op1, op2, addr)
+    : mne == MNE_DJNZ ? encode_jr(0020, op1, op2, addr)
+    : mne == MNE_RST && is_imm(op1) && is_none(op2) && (op1.value & ~0070) == 0 ? emit(0, 0307 | op1.value)
+    : mne == MNE_PUSH ? encode_push_pop(0305, op1, op2, p)
+    : mne == MNE_POP ? encode_push_pop(0301, op1, op2, p)
+    : mne == MNE_EX ? encode_ex(op1, op2, p)
+    : mne == MNE_IN ? encode_in(op1, op2)
+    : mne == MNE_OUT ? encode_out(op1, op2)
+    : mne == MNE_IM && is_imm(op1) && is_none(op2) && op1.value < 3
+      ? emit(PREFIX_ED, op1.value == 0 ? 0106 : op1.value == 1 ? 0126 : 0136)
+    : find_value(ROT_MNE, mne) < sizeof(ROT_MNE) && is_none(op2)
+      ? emit_cb(p, find_value(ROT_MNE, mne) << 3, op1)
+    : find_value(CB_MNE, mne) < sizeof(CB_MNE) && is_imm(op1) && op1.value < 8
+      ? emit_cb(p, find_value(CB_MNE, mne) << 6 | op1.value << 3, op2)
+    : error_bad_operands();
+}
+
+// ============================================================================
+// Source Assembly
+// ============================================================================
+
+constexpr Encoding encode_ops(uint8_t mne, Operand op1, Operand op2, const char* end, uint16_t addr) {
+  return is_eol(*end)
+    ? encode(mne, op1, op2, op_prefix(index_prefix(op1.token), index_prefix(op2.token)), addr)
+    : error_bad_operands();
+}
+
+// Split operands at comma following op1 field [s, e)
+constexpr Encoding encode_fields(uint8_t mne, const char* s, const char* e,
+    const char* source, uint16_t org, uint16_t addr) {
+  return *e == ','
+    ? encode_ops(mne, parse_field(s, e, source, org, addr),
+      parse_field(e + 1, field_end(e + 1), source, org, addr), field_end(e + 1), addr)
+    : encode_ops(mne, parse_field(s, e, source, org, addr), Operand(), e, addr);
+}
+
+constexpr Encoding encode_mnemonic(uint8_t mne, const char* s, const char* source, uint16_t org, uint16_t addr) {
+  return mne == MNE_INVALID ? error_bad_mnemonic()
+    : encode_fields(mne, s, field_end(s), source, org, addr);
+}
+
+constexpr Encoding encode_statement(const char* s, const char* source, uint16_t org, uint16_t addr) {
+  return is_eol(*s) ? Encoding{0, {}}
+    : encode_mnemonic(find_name(MNE_NAMES, s, skip_word(s)), skip_word(s), source, org, addr);
+}
+
+// Encode line assembled at addr; empty lines, labels, and comments take no space
+constexpr Encoding encode_line(const char* line, const char* source, uint16_t org, uint16_t addr) {
+  return encode_statement(skip_label(skip_space(line)), source, org, addr);
+}
+
+// Size of source following line at addr
+constexpr uint16_t source_size(const char* line, const char* source, uint16_t org, uint16_t addr) {
+  return *line == '\0' ? addr - org
+    : source_size(next_line(line), source, org, addr + encode_line(line, source, org, addr).size);
+}
+
+constexpr uint8_t source_byte(const char* line, const char* source, uint16_t org, uint16_t addr, uint16_t i);
+
+constexpr uint8_t code_byte(Encoding code, const char* line, const char* source, uint16_t org, uint16_t addr, uint16_t i) {
+  return i < code.size ? code.bytes[i]
+    : source_byte(next_line(line), source, org, addr + code.size, i - code.size);
+}
+
+// Byte i of source following line at addr
+constexpr uint8_t source_byte(const char* line, const char* source, uint16_t org, uint16_t addr, uint16_t i) {
+  return code_byte(encode_line(line, source, org, addr), line, source, org, addr, i);
+}
+
+// Code must fit in one write_bytes
+constexpr uint8_t checked_size(uint16_t size) {
+  return size > 0 && size < 256 ? size : error_bad_size();
+}
+
+// Flash memory array of Source::text() assembled for ORIGIN
+template <typename Source, uint16_t ORIGIN = 0,
+  typename Seq = typename MakeIndexSeq<checked_size(source_size(Source::text(), Source::text(), ORIGIN, ORIGIN))>::type>
+struct Assemble;
+
+template <typename Source, uint16_t ORIGIN, uint8_t... I>
+struct Assemble<Source, ORIGIN, IndexSeq<I...>> {
+  static constexpr const uint16_t ORG = ORIGIN;
+  static constexpr const uint8_t SIZE = sizeof...(I);
+  static const uint8_t code[sizeof...(I)];
+};
+
+template <typename Source, uint16_t ORIGIN, uint8_t... I>
+constexpr const uint16_t Assemble<Source, ORIGIN, IndexSeq<I...>>::ORG;
+
+template <typename Source, uint16_t ORIGIN, uint8_t... I>
+constexpr const uint8_t Assemble<Source, ORIGIN, IndexSeq<I...>>::SIZE;
+
+template <typename Source, uint16_t ORIGIN, uint8_t... I>
+const uint8_t Assemble<Source, ORIGIN, IndexSeq<I...>>::code[sizeof...(I)] PROGMEM = {
+  source_byte(Source::text(), Source::text(), ORIGIN, ORIGIN, I)...
+};
+
+// Copy assembled code from Flash to Code::ORG with one bulk write
+template <typename API, typename Code>
+void upload() {
+  uint8_t buf[Code::SIZE];
+  for (uint8_t i = 0; i < Code::SIZE; ++i) {
+    buf[i] = pgm_read_byte((const char*)&Code::code[i]);
+  }
+  API::write_bytes(Code::ORG, buf, Code::SIZE);
+}
+
+} // namespace casm
+} // namespace z80
+} // namespace uMon
+
+// Define NAME as the Z80 code assembled from SOURCE for address ORG
+#define uMON_Z80_ASM(NAME, ORG, SOURCE) \
+  struct NAME##_Source { static constexpr const char* text() { return SOURCE; } }; \
+  using NAME = ::uMon::z80::casm::Assemble<NAME##_Source, ORG>
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "uMon/format.hpp"
+#include "uMon/hash.hpp"
 
 namespace uMon {
 namespace z80 {
@@ -47,6 +48,24 @@ const char* const MNE_STR[] PROGMEM = {
 #undef ITEM
 };
 
+// Mnemonic strings for compile-time hashing only
+constexpr const char* const MNE_NAMES[] = {
+#define ITEM(x) #x,
+#include "mnemonics.def"
+#undef ITEM
+};
+
+// Perfect hash from mnemonic string to index
+struct MneHash {
+  static constexpr const uint8_t MULT = 15;
+  static constexpr const uint8_t SEED = 60;
+  static constexpr const uint8_t MASK = 0xFF;
+  static constexpr uint8_t slot(uint8_t i) { return hash_find_slot(MNE_NAMES, i, MULT, SEED, MASK); }
+};
+
+static_assert(hash_is_perfect(MNE_NAMES, MneHash::MULT, MneHash::SEED, MneHash::MASK),
+  "mnemonics collide; find new MneHash constants with notes/perfect_hash.py");
+
 // ============================================================================
 // ALU Encodings
 // ============================================================================
@@ -61,7 +80,7 @@ ALU_LIST
 };
 
 // Mapping from ALU encoding to mnemonic
-const uint8_t ALU_MNE[] = {
+constexpr const uint8_t ALU_MNE[] = {
 #define ITEM(x) MNE_##x,
 ALU_LIST
 #undef ITEM
@@ -83,7 +102,7 @@ CB_LIST
 };
 
 // Mapping from CB op to mnemonic
-const uint8_t CB_MNE[] = {
+constexpr const uint8_t CB_MNE[] = {
   MNE_INVALID,
 #define ITEM(x) MNE_##x,
 CB_LIST
@@ -106,7 +125,7 @@ ROT_LIST
 };
 
 // Mapping from ROT op to mnemonic
-const uint8_t ROT_MNE[] = {
+constexpr const uint8_t ROT_MNE[] = {
 #define ITEM(x) MNE_##x,
 ROT_LIST
 #undef ITEM
@@ -114,28 +133,6 @@ ROT_LIST
 
 #undef ROT_LIST
 
-// ============================================================================
-// Misc Encodings
-// ============================================================================
-
-#define MISC_LIST \
-ITEM(RLCA) ITEM(RRCA) ITEM(RLA) ITEM(RRA) ITEM(DAA) ITEM(CPL) ITEM(SCF) ITEM(CCF)
-
-enum {
-#define ITEM(x) MISC_##x,
-MISC_LIST
-#undef ITEM
-};
-
-// Mapping from MISC op to mnemonic
-const uint8_t MISC_MNE[] = {
-#define ITEM(x) MNE_##x,
-MISC_LIST
-#undef ITEM
-};
-
-#undef MISC_LIST
-
 // ============================================================================
 // Token Definitions
 // ============================================================================
@@ -148,6 +145,7 @@ enum {
 #undef ITEM
   TOK_INVALID,
   TOK_IMMEDIATE,
+  TOK_WILDCARD, // search pattern; value is base token of (IX/IY+*) or 0
   TOK_MASK = 0x1F,
   TOK_BYTE = 0x20,
   TOK_DIGIT = 0x40,
@@ -175,8 +173,27 @@ const char* const TOK_STR[] PROGMEM = {
 #undef ITEM
 };
 
+// Token strings for compile-time hashing only
+constexpr const char* const TOK_NAMES[] = {
+  "?",
+#define ITEM(x) #x,
+#include "tokens.def"
+#undef ITEM
+};
+
+// Perfect hash from token string to index
+struct TokHash {
+  static constexpr const uint8_t MULT = 7;
+  static constexpr const uint8_t SEED = 23;
+  static constexpr const uint8_t MASK = 0x3F;
+  static constexpr uint8_t slot(uint8_t i) { return hash_find_slot(TOK_NAMES, i, MULT, SEED, MASK); }
+};
+
+static_assert(hash_is_perfect(TOK_NAMES, TokHash::MULT, TokHash::SEED, TokHash::MASK),
+  "tokens collide; find new TokHash constants with notes/perfect_hash.py");
+
 // Convert token to IX/IY prefix
-uint8_t token_to_prefix(uint8_t token) {
+inline uint8_t token_to_prefix(uint8_t token) {
   switch (token & TOK_MASK) {
   case TOK_IX: case TOK_IXH: case TOK_IXL:
     return PREFIX_IX;
@@ -187,6 +204,102 @@ uint8_t token_to_prefix(uint8_t token) {
   }
 }
 
+// ============================================================================
+// Fixed Encodings
+// ============================================================================
+
+// Instruction whose operands, if any, leave nothing to encode
+struct Fixed {
+  uint8_t mnemonic;
+  uint8_t op1; // TOK_INVALID if absent
+  uint8_t op2; // TOK_INVALID if absent
+  uint8_t prefix; // 0 or PREFIX_ED
+  uint8_t code;
+};
+
+// Fixed encodings for compile-time lookup only
+constexpr const Fixed FIXED[] = {
+#define ITEM(mne, op1, op2, prefix, code) { MNE_##mne, TOK_##op1, TOK_##op2, prefix, code },
+#include "fixed.def"
+#undef ITEM
+};
+
+// Flash memory table of fixed encodings for asm_instruction and dasm
+const Fixed FIXED_PGM[] PROGMEM = {
+#define ITEM(mne, op1, op2, prefix, code) { MNE_##mne, TOK_##op1, TOK_##op2, prefix, code },
+#include "fixed.def"
+#undef ITEM
+};
+
+constexpr const uint8_t N_FIXED = sizeof(FIXED) / sizeof(FIXED[0]);
+
+// Copy entry i of FIXED_PGM out of flash
+inline Fixed read_fixed(uint8_t i) {
+  const Fixed& entry = FIXED_PGM[i];
+  return {
+    uint8_t(pgm_read_byte((const char*)&entry.mnemonic)),
+    uint8_t(pgm_read_byte((const char*)&entry.op1)),
+    uint8_t(pgm_read_byte((const char*)&entry.op2)),
+    uint8_t(pgm_read_byte((const char*)&entry.prefix)),
+    uint8_t(pgm_read_byte((const char*)&entry.code)),
+  };
+}
+constexpr const uint16_t FIXED_NONE = 0xFFFF;
+
+// Index of first entry for mnemonic, or N_FIXED
+constexpr uint8_t fixed_first(uint8_t mnemonic, uint8_t i = 0) {
+  return i == N_FIXED || FIXED[i].mnemonic == mnemonic ? i : fixed_first(mnemonic, i + 1);
+}
+
+// Index of first entry encoded by prefix and code, or N_FIXED
+constexpr uint8_t fixed_index(uint8_t prefix, uint8_t code, uint8_t i = 0) {
+  return i == N_FIXED || (FIXED[i].prefix == prefix && FIXED[i].code == code) ? i
+    : fixed_index(prefix, code, i + 1);
+}
+
+// Encoding as prefix << 8 | code of mnemonic with operand tokens, or FIXED_NONE
+constexpr uint16_t fixed_code(uint8_t mnemonic, uint8_t op1, uint8_t op2, uint8_t i = 0) {
+  return i == N_FIXED ? FIXED_NONE
+    : FIXED[i].mnemonic == mnemonic && FIXED[i].op1 == op1 && FIXED[i].op2 == op2
+      ? uint16_t(FIXED[i].prefix << 8 | FIXED[i].code)
+    : fixed_code(mnemonic, op1, op2, i + 1);
+}
+
+// Mnemonic encoded by prefix and code, or MNE_INVALID
+constexpr uint8_t fixed_mnemonic(uint8_t prefix, uint8_t code) {
+  return fixed_index(prefix, code) < N_FIXED ? FIXED[fixed_index(prefix, code)].mnemonic
+    : uint8_t(MNE_INVALID);
+}
+
+// True if no mnemonic has entries apart from each other
+constexpr bool fixed_is_grouped(uint8_t i = 1) {
+  return i >= N_FIXED ? true
+    : FIXED[i].mnemonic != FIXED[i - 1].mnemonic && fixed_first(FIXED[i].mnemonic) != i ? false
+    : fixed_is_grouped(i + 1);
+}
+
+static_assert(fixed_is_grouped(), "fixed.def entries of a mnemonic must be adjacent");
+
+// Flash memory table from mnemonic to fixed_first, 1 byte per mnemonic
+template <typename Seq = MakeIndexSeq<MNE_INVALID>::type>
+struct FixedFirst;
+
+template <uint8_t... I>
+struct FixedFirst<IndexSeq<I...>> {
+  static const uint8_t table[sizeof...(I)];
+};
+
+template <uint8_t... I>
+const uint8_t FixedFirst<IndexSeq<I...>>::table[sizeof...(I)] PROGMEM = { fixed_first(I)... };
+
+// Mapping from misc AF op [00 --- 111] to mnemonic
+constexpr const uint8_t MISC_MNE[] = {
+  fixed_mnemonic(0, 0007), fixed_mnemonic(0, 0017),
+  fixed_mnemonic(0, 0027), fixed_mnemonic(0, 0037),
+  fixed_mnemonic(0, 0047), fixed_mnemonic(0, 0057),
+  fixed_mnemonic(0, 0067), fixed_mnemonic(0, 0077),
+};
+
 // ============================================================================
 // Register Encodings
 // ============================================================================
@@ -209,28 +322,28 @@ REG_LIST
 };
 
 // Mapping from reg encoding to token
-const uint8_t REG_TOK[] = {
+constexpr const uint8_t REG_TOK[] = {
 #define ITEM(name, tok, tok_ix, tok_iy) tok,
 REG_LIST
 #undef ITEM
 };
 
 // Mapping from reg encoding to token with IX prefix
-const uint8_t REG_TOK_IX[] = {
+constexpr const uint8_t REG_TOK_IX[] = {
 #define ITEM(name, tok, tok_ix, tok_iy) tok_ix,
 REG_LIST
 #undef ITEM
 };
 
 // Mapping from reg encoding to token with IY prefix
-const uint8_t REG_TOK_IY[] = {
+constexpr const uint8_t REG_TOK_IY[] = {
 #define ITEM(name, tok, tok_ix, tok_iy) tok_iy,
 REG_LIST
 #undef ITEM
 };
 
 // Convert token to primary register
-uint8_t token_to_reg(uint8_t token, uint8_t prefix = 0) {
+inline uint8_t token_to_reg(uint8_t token, uint8_t prefix = 0) {
   switch (prefix) {
   case PREFIX_IX: return index_of(REG_TOK_IX, token);
   case PREFIX_IY: return index_of(REG_TOK_IY, token);
@@ -240,7 +353,7 @@ uint8_t token_to_reg(uint8_t token, uint8_t prefix = 0) {
 
 // Translate reg to token, optionally with IX/IY prefix, or (HL)
 // (IX/IY+disp) should be handled with read_index_ind instead
-uint8_t reg_to_token(uint8_t reg, uint8_t prefix) {
+inline uint8_t reg_to_token(uint8_t reg, uint8_t prefix) {
   if (prefix != 0 && reg == REG_H) {
     return prefix == PREFIX_IX ? TOK_IXH : TOK_IYH;
   } else if (prefix != 0 && reg == REG_L) {
@@ -265,14 +378,14 @@ PAIR_LIST
 };
 
 // Mapping from pair encoding to token
-const uint8_t PAIR_TOK[] = {
+constexpr const uint8_t PAIR_TOK[] = {
 #define ITEM(x) TOK_##x,
 PAIR_LIST
 #undef ITEM
 };
 
 // Convert token to register pair
-uint8_t token_to_pair(uint8_t token, uint8_t prefix = 0, bool use_af = false) {
+inline uint8_t token_to_pair(uint8_t token, uint8_t prefix = 0, bool use_af = false) {
   if (prefix == PREFIX_IX) {
     if (token == TOK_IX) return PAIR_HL;
     if (token == TOK_HL) return PAIR_INVALID;
@@ -288,7 +401,7 @@ uint8_t token_to_pair(uint8_t token, uint8_t prefix = 0, bool use_af = false) {
 }
 
 // Translate pair to token, replacing HL with IX/IY if prefixed, and SP with AF if flagged
-uint8_t pair_to_token(uint8_t pair, uint8_t prefix, bool use_af = false) {
+inline uint8_t pair_to_token(uint8_t pair, uint8_t prefix, bool use_af = false) {
   const bool has_prefix = prefix != 0;
   if (has_prefix && pair == PAIR_HL) {
     return prefix == PREFIX_IX ? TOK_IX : TOK_IY;
@@ -315,14 +428,14 @@ COND_LIST
 };
 
 // Mapping from cond encoding to token
-const uint8_t COND_TOK[] = {
+constexpr const uint8_t COND_TOK[] = {
 #define ITEM(x) TOK_##x,
 COND_LIST
 #undef ITEM
 };
 
 // Convert token to branch condition
-uint8_t token_to_cond(uint8_t token) {
+inline uint8_t token_to_cond(uint8_t token) {
   return index_of(COND_TOK, token);
 }
 
@@ -337,9 +450,9 @@ struct Operand {
   uint8_t token;
   uint16_t value;
 
-  Operand(): token(TOK_INVALID), value(0) {}
-  Operand(uint8_t token): token(token), value(0) {}
-  Operand(uint8_t token, uint16_t value): token(token), value(value) {}
+  constexpr Operand(): token(TOK_INVALID), value(0) {}
+  constexpr Operand(uint8_t token): token(token), value(0) {}
+  constexpr Operand(uint8_t token, uint16_t value): token(token), value(value) {}
 };
 
 // Maximum number of operands encoded by an instruction
@@ -349,65 +462,115 @@ constexpr const uint8_t MAX_OPERANDS = 2;
 struct Instruction {
   uint8_t mnemonic;
   Operand operands[MAX_OPERANDS];
+  // NOTE undocumented DDCB/FDCB ops also copy result to this register
+  uint8_t copy_token;
 
-  Instruction(): mnemonic(MNE_INVALID) {}
-  Instruction(uint8_t mnemonic): mnemonic(mnemonic) {}
-  Instruction(uint8_t mnemonic, Operand op1): mnemonic(mnemonic), operands{op1, {}} {}
-  Instruction(uint8_t mnemonic, Operand op1, Operand op2): mnemonic(mnemonic), operands{op1, op2} {}
+  Instruction(): mnemonic(MNE_INVALID), copy_token(TOK_INVALID) {}
+  Instruction(uint8_t mnemonic): mnemonic(mnemonic), copy_token(TOK_INVALID) {}
+  Instruction(uint8_t mnemonic, Operand op1): mnemonic(mnemonic), operands{op1, {}}, copy_token(TOK_INVALID) {}
+  Instruction(uint8_t mnemonic, Operand op1, Operand op2): mnemonic(mnemonic), operands{op1, op2}, copy_token(TOK_INVALID) {}
 };
 
-// Nicely format an instruction operand
-template <typename API>
-void print_operand(Operand& op) {
+// Nicely format an instruction operand into out, a FormatBuffer or PrintOut
+template <typename API, typename Out>
+void format_operand(Out& out, const Operand& op) {
   const bool is_indirect = (op.token & TOK_INDIRECT) != 0;
   const bool is_byte = (op.token & TOK_BYTE) != 0;
   const bool is_digit = (op.token & TOK_DIGIT) != 0;
   const uint8_t token = op.token & TOK_MASK;
-  if (is_indirect) API::print_char('(');
+  if (is_indirect) out('(');
   if (token < TOK_INVALID) {
-    print_pgm_table<API>(TOK_STR, token);
+    out.print_pgm_table(TOK_STR, token);
     if (op.value != 0) {
       int8_t value = op.value;
-      API::print_char(value < 0 ? '-' : '+');
-      API::print_char('$');
-      format_hex8(API::print_char, value < 0 ? -value : value);
+      out(value < 0 ? '-' : '+');
+      out('$');
+      format_hex8(out, value < 0 ? -value : value);
     }
   } else if (token == TOK_IMMEDIATE) {
     if (is_digit) {
-      API::print_char('0' + op.value);
+      out('0' + op.value);
     } else if (is_byte) {
-      API::print_char('$');
-      format_hex8(API::print_char, op.value);
+      out('$');
+      format_hex8(out, op.value);
     } else {
       const char* label;
       if (API::get_labels().get_name(op.value, label)) {
-        API::print_string(label);
+        out.print_string(label);
       } else {
-        API::print_char('$');
-        format_hex16(API::print_char, op.value);
+        out('$');
+        format_hex16(out, op.value);
       }
     }
+  } else if (token == TOK_WILDCARD) {
+    if (op.value != TOK_UNDEFINED) {
+      out.print_pgm_table(TOK_STR, op.value);
+      out('+');
+    }
+    out('*');
   } else {
-    API::print_char('?');
+    out('?');
   }
-  if (is_indirect) API::print_char(')');
+  if (is_indirect) out(')');
 }
 
-// Nicely format an instruction and its operands
-template <typename API>
-void print_instruction(Instruction& inst) {
+// Nicely format an instruction and its operands into out
+template <typename API, typename Out>
+void format_instruction(Out& out, const Instruction& inst) {
   if (inst.mnemonic == MNE_INVALID) {
-    API::print_char('?');
+    // Print invalid code as hex if recorded by decoder
+    if (inst.operands[0].token == TOK_IMMEDIATE) {
+      out('$');
+      format_hex16(out, inst.operands[0].value);
+    }
+    out('?');
     return;
   }
-  print_pgm_table<API>(MNE_STR, inst.mnemonic);
+  if (inst.copy_token != TOK_INVALID) {
+    out.print_pgm_string(MNE_STR_LD);
+    out(' ');
+    out.print_pgm_table(TOK_STR, inst.copy_token);
+    out(';');
+  }
+  out.print_pgm_table(MNE_STR, inst.mnemonic);
   for (uint8_t i = 0; i < MAX_OPERANDS; ++i) {
-    Operand& op = inst.operands[i];
+    const Operand& op = inst.operands[i];
     if (op.token == TOK_INVALID) break;
-    API::print_char(i == 0 ? ' ' : ',');
-    print_operand<API>(op);
+    out(i == 0 ? ' ' : ',');
+    format_operand<API>(out, op);
   }
 }
 
+// Format instruction into null-terminated buf of size n, truncating if needed
+// Returns length of string written; nothing is written if n is 0
+template <typename API>
+size_t format_instruction(char* buf, size_t n, const Instruction& inst) {
+  if (n == 0) return 0;
+  FormatBuffer out(buf, n);
+  format_instruction<API>(out, inst);
+  return out.finish();
+}
+
+// Sends formatted text straight to API, so labels of any length print whole
+template <typename API>
+struct PrintOut {
+  void operator()(char c) { API::print_char(c); }
+  void print_string(const char* str) { API::print_string(str); }
+  void print_pgm_string(const char* str) { uMon::print_pgm_string<API>(str); }
+  void print_pgm_table(const char* const table[], uint8_t index) { uMon::print_pgm_table<API>(table, index); }
+};
+
+template <typename API>
+void print_operand(const Operand& op) {
+  PrintOut<API> out;
+  format_operand<API>(out, op);
+}
+
+template <typename API>
+void print_instruction(const Instruction& inst) {
+  PrintOut<API> out;
+  format_instruction<API>(out, inst);
+}
+
 } // namespace z80
 } // namespace uMon
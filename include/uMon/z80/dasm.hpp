@@ -8,19 +8,37 @@
 
 #include "uMon/z80/common.hpp"
 #include "uMon/format.hpp"
+#include "uMon/labels.hpp"
+#include "uMon/regions.hpp"
 
 #include <stdint.h>
+#include <string.h>
 
 namespace uMon {
 namespace z80 {
 
-// Print given code as hex followed by '?'
-template <typename API>
-void print_prefix_error(uint8_t prefix, uint8_t code) {
-  API::print_char('$');
-  format_hex8(API::print_char, prefix);
-  format_hex8(API::print_char, code);
-  API::print_char('?');
+// Mark instruction invalid, keeping given code to be printed as hex with '?'
+inline void set_prefix_error(Instruction& inst, uint8_t prefix, uint8_t code) {
+  inst.mnemonic = MNE_INVALID;
+  inst.operands[0] = { TOK_IMMEDIATE, uint16_t(prefix << 8 | code) };
+}
+
+// Fill instruction from fixed.def entry i
+// Returns 1 for the opcode byte
+inline uint8_t decode_fixed(Instruction& inst, uint8_t i) {
+  const Fixed entry = read_fixed(i);
+  inst.mnemonic = entry.mnemonic;
+  inst.operands[0].token = entry.op1;
+  inst.operands[1].token = entry.op2;
+  return 1;
+}
+
+// Fill instruction from the fixed.def entry for an opcode placed by pattern
+template <uint8_t PREFIX, uint8_t CODE>
+uint8_t decode_fixed(Instruction& inst) {
+  constexpr const uint8_t i = fixed_index(PREFIX, CODE);
+  static_assert(i < N_FIXED, "fixed.def has no entry for decoded opcode");
+  return decode_fixed(inst, i);
 }
 
 // Convert 1-byte immediate at addr to Operand
@@ -61,7 +79,7 @@ Operand read_index_ind(uint16_t addr, uint8_t prefix) {
 }
 
 // Decode IN/OUT (c): ED [01 --- 00-]
-uint8_t decode_in_out_c(Instruction& inst, uint8_t code) {
+inline uint8_t decode_in_out_c(Instruction& inst, uint8_t code) {
   const bool is_out = (code & 01) == 01;
   const uint8_t reg = (code & 070) >> 3;
   const bool is_ind = reg == REG_M;
@@ -73,7 +91,7 @@ uint8_t decode_in_out_c(Instruction& inst, uint8_t code) {
 }
 
 // Decode 16-bit ADC/SBC: ED [01 --- 010]
-uint8_t decode_hl_adc(Instruction& inst, uint8_t code) {
+inline uint8_t decode_hl_adc(Instruction& inst, uint8_t code) {
   const bool is_adc = (code & 010) == 010;
   const uint8_t pair = (code & 060) >> 4;
   inst.mnemonic = is_adc ? MNE_ADC : MNE_SBC;
@@ -94,7 +112,7 @@ uint8_t decode_ld_pair_ind(Instruction& inst, uint16_t addr, uint8_t code) {
 }
 
 // Decode IM 0/1/2: ED [01 --- 110]
-uint8_t decode_im(Instruction& inst, uint8_t code) {
+inline uint8_t decode_im(Instruction& inst, uint8_t code) {
   inst.mnemonic = MNE_IM;
   // NOTE only 0x46, 0x56, 0x5E are documented; '?' sets an undefined mode
   const uint8_t mode = (code & 030) >> 3;
@@ -108,33 +126,33 @@ uint8_t decode_im(Instruction& inst, uint8_t code) {
 }
 
 // Decode LD I/R and RRD/RLD: ED [01 --- 111]
-template <typename API>
-uint8_t decode_ld_ir(Instruction& inst, uint8_t code) {
-  const bool is_rot = (code & 040) == 040; // is RRD/RLD
-  const bool is_load = (code & 020) == 020; // is LD A,I/R
-  const bool is_rl = (code & 010) == 010; // is LD -R- or RLD
-  if (is_rot) {
-    if (is_load) {
-      print_prefix_error<API>(PREFIX_ED, code);
-    } else {
-      inst.mnemonic = is_rl ? MNE_RLD : MNE_RRD;
-    }
-  } else {
-    inst.mnemonic = MNE_LD;
-    inst.operands[is_load ? 0 : 1].token = TOK_A;
-    inst.operands[is_load ? 1 : 0].token = is_rl ? TOK_R : TOK_I;
+inline uint8_t decode_ld_ir(Instruction& inst, uint8_t code) {
+  static constexpr const uint8_t OPS[] = {
+    fixed_index(PREFIX_ED, 0107), fixed_index(PREFIX_ED, 0117), // LD I/R,A
+    fixed_index(PREFIX_ED, 0127), fixed_index(PREFIX_ED, 0137), // LD A,I/R
+    fixed_index(PREFIX_ED, 0147), fixed_index(PREFIX_ED, 0157), // RRD/RLD
+  };
+  static_assert(OPS[0] < N_FIXED && OPS[1] < N_FIXED && OPS[2] < N_FIXED
+    && OPS[3] < N_FIXED && OPS[4] < N_FIXED && OPS[5] < N_FIXED,
+    "fixed.def has no entry for decoded opcode");
+  const uint8_t op = (code & 070) >> 3;
+  if (op >= sizeof(OPS)) {
+    set_prefix_error(inst, PREFIX_ED, code);
+    return 1;
   }
-  return 1;
+  return decode_fixed(inst, OPS[op]);
 }
 
 // Decode block transfer ops: ED [10 1-- 0--]
-uint8_t decode_block_ops(Instruction& inst, uint8_t code) {
+inline uint8_t decode_block_ops(Instruction& inst, uint8_t code) {
+#define OP(op, var) fixed_mnemonic(PREFIX_ED, 0240 | (var) << 3 | (op))
   static constexpr const uint8_t OPS[4][4] = {
-    { MNE_LDI, MNE_LDD, MNE_LDIR, MNE_LDDR },
-    { MNE_CPI, MNE_CPD, MNE_CPIR, MNE_CPDR },
-    { MNE_INI, MNE_IND, MNE_INIR, MNE_INDR },
-    { MNE_OUTI, MNE_OUTD, MNE_OTIR, MNE_OTDR },
+    { OP(0, 0), OP(0, 1), OP(0, 2), OP(0, 3) },
+    { OP(1, 0), OP(1, 1), OP(1, 2), OP(1, 3) },
+    { OP(2, 0), OP(2, 1), OP(2, 2), OP(2, 3) },
+    { OP(3, 0), OP(3, 1), OP(3, 2), OP(3, 3) },
   };
+#undef OP
   const uint8_t op = (code & 03);
   const uint8_t var = (code & 030) >> 3;
   inst.mnemonic = OPS[op][var];
@@ -155,21 +173,19 @@ uint8_t decode_ed(Instruction& inst, uint16_t addr) {
       return decode_ld_pair_ind<API>(inst, addr, code);
     case 4:
       // NOTE all 1-4 codes do NEG, but only 104 is documented
-      inst.mnemonic = MNE_NEG;
-      return 1;
+      return decode_fixed<PREFIX_ED, 0104>(inst);
     case 5:
       // NOTE all 1-5 codes (except 115 RETI) do RETN, but only 105 is documented
-      inst.mnemonic = code == 0115 ? MNE_RETI : MNE_RETN;
-      return 1;
+      return code == 0115 ? decode_fixed<PREFIX_ED, 0115>(inst) : decode_fixed<PREFIX_ED, 0105>(inst);
     case 6:
       return decode_im(inst, code);
     case 7:
-      return decode_ld_ir<API>(inst, code);
+      return decode_ld_ir(inst, code);
     }
   } else if ((code & 0344) == 0240) {
     return decode_block_ops(inst, code);
   }
-  print_prefix_error<API>(PREFIX_ED, code);
+  set_prefix_error(inst, PREFIX_ED, code);
   return 1;
 }
 
@@ -194,10 +210,7 @@ uint8_t decode_cb(Instruction& inst, uint16_t addr, uint8_t prefix) {
     if (op != CB_BIT && reg != REG_M) {
       // NOTE operand other than (HL) is undocumented
       // (IX/IY) is still used, but result also copied to reg
-      print_pgm_string<API>(MNE_STR_LD);
-      API::print_char(' ');
-      print_pgm_table<API>(TOK_STR, REG_TOK[reg]);
-      API::print_char(';');
+      inst.copy_token = REG_TOK[reg];
     }
     // Print (IX/IY+disp)
     reg_op = read_index_ind<API>(addr, prefix);
@@ -214,13 +227,9 @@ template <typename API>
 uint8_t decode_jr(Instruction& inst, uint16_t addr, uint8_t code) {
   switch (code & 070) {
   case 000:
-    inst.mnemonic = MNE_NOP;
-    return 1;
+    return decode_fixed<0, 0000>(inst); // NOP
   case 010:
-    inst.mnemonic = MNE_EX;
-    inst.operands[0].token = TOK_AF;
-    inst.operands[1].token = TOK_AF;
-    return 1;
+    return decode_fixed<0, 0010>(inst); // EX AF,AF
   case 020:
     inst.mnemonic = MNE_DJNZ;
     inst.operands[0] = read_branch_disp<API>(addr + 1);
@@ -258,22 +267,26 @@ uint8_t decode_ld_add_pair(Instruction& inst, uint16_t addr, uint8_t code, uint8
 // Disassemble indirect loads: [00 --- 010]
 template <typename API>
 uint8_t decode_ld_ind(Instruction& inst, uint16_t addr, uint8_t code, uint8_t prefix) {
+  // LD (BC/DE),A and LD A,(BC/DE) are in fixed.def
+  if ((code & 040) == 0) {
+    static constexpr const uint8_t OPS[] = {
+      fixed_index(0, 0002), fixed_index(0, 0012), fixed_index(0, 0022), fixed_index(0, 0032),
+    };
+    static_assert(OPS[0] < N_FIXED && OPS[1] < N_FIXED && OPS[2] < N_FIXED && OPS[3] < N_FIXED,
+      "fixed.def has no entry for decoded opcode");
+    return decode_fixed(inst, OPS[(code & 030) >> 3]);
+  }
   // Decode 070 bitfield
   const bool is_store = (code & 010) == 0; // A/HL is src instead of dst
-  const bool use_hl = (code & 060) == 040; // Use HL instead of A
-  const bool use_pair = (code & 040) == 0; // Use (BC/DE) instead of (nn)
+  const bool use_hl = (code & 020) == 0; // Use HL instead of A
   Operand& op_reg = inst.operands[is_store ? 1 : 0];
   Operand& op_addr = inst.operands[is_store ? 0 : 1];
   // Convert instruction to tokens
   inst.mnemonic = MNE_LD;
   op_reg.token = use_hl ? pair_to_token(PAIR_HL, prefix) : TOK_A;
-  if (use_pair) {
-    op_addr.token = PAIR_TOK[(code & 020) >> 4] | TOK_INDIRECT;
-  } else {
-    op_addr = read_imm_word<API>(addr + 1, true);
-  }
   // Opcodes followed by (nn) consume 2 extra bytes
-  return use_pair ? 1 : 3;
+  op_addr = read_imm_word<API>(addr + 1, true);
+  return 3;
 }
 
 // Disassemble LD r, n: ([ix/iy]) [00 r 110] ([d]) [n]
@@ -322,8 +335,7 @@ template <typename API>
 uint8_t decode_ld_reg_reg(Instruction& inst, uint16_t addr, uint8_t code, uint8_t prefix) {
   // Replace LD (HL),(HL) with HALT
   if (code == 0x76) {
-    inst.mnemonic = MNE_HALT;
-    return 1;
+    return decode_fixed<0, 0x76>(inst);
   }
   inst.mnemonic = MNE_LD;
   const uint8_t dest = (code & 070) >> 3;
@@ -396,12 +408,10 @@ uint8_t decode_push_pop(Instruction& inst, uint16_t addr, uint8_t code, uint8_t
       inst.operands[0] = read_imm_word<API>(addr + 1);
       return 3;
     } else {
-      inst.mnemonic = MNE_RET;
-      return 1;
+      return decode_fixed<0, 0311>(inst); // RET
     }
   case 030:
-    inst.mnemonic = MNE_EXX;
-    return 1;
+    return decode_fixed<0, 0331>(inst); // EXX
   case 050:
     inst.mnemonic = MNE_JP;
     inst.operands[0].token = pair_to_token(PAIR_HL, prefix) | TOK_INDIRECT;
@@ -446,16 +456,11 @@ uint8_t decode_misc_hi(Instruction& inst, uint16_t addr, uint8_t code, uint8_t p
     return 1;
   case 050:
     // NOTE EX DE,HL unaffected by prefix
-    inst.mnemonic = MNE_EX;
-    inst.operands[0].token = TOK_DE;
-    inst.operands[1].token = TOK_HL;
-    return 1;
+    return decode_fixed<0, 0353>(inst);
   case 060:
-    inst.mnemonic = MNE_DI;
-    return 1;
+    return decode_fixed<0, 0363>(inst); // DI
   default: // 070
-    inst.mnemonic = MNE_EI;
-    return 1;
+    return decode_fixed<0, 0373>(inst); // EI
   }
 }
 
@@ -467,7 +472,7 @@ uint8_t dasm_instruction(Instruction& inst, uint16_t addr, uint8_t prefix = 0) {
   if (code == PREFIX_IX || code == PREFIX_ED || code == PREFIX_IY) {
     if (prefix != 0) {
       // Discard old prefix and start over
-      print_prefix_error<API>(prefix, code);
+      set_prefix_error(inst, prefix, code);
       return 0;
     } else {
       // Add 1 to size for prefix
@@ -527,15 +532,349 @@ uint8_t dasm_instruction(Instruction& inst, uint16_t addr, uint8_t prefix = 0) {
   }
 }
 
+// Size of unprefixed opcode, not counting any index displacement
+inline uint8_t opcode_length(uint8_t code) {
+  switch (code & 0307) {
+  case 0000: return (code & 070) >= 020 ? 2 : 1; // DJNZ/JR : NOP/EX AF
+  case 0001: return (code & 010) == 0 ? 3 : 1; // LD rr,nn : ADD HL,rr
+  case 0002: return (code & 040) != 0 ? 3 : 1; // LD (nn) : LD (BC/DE)
+  case 0006: return 2; // LD r,n
+  case 0302: return 3; // JP cc,nn
+  case 0303:
+    switch (code & 070) {
+    case 000: return 3; // JP nn
+    case 010: case 020: case 030: return 2; // CB prefix, OUT (n),A, IN A,(n)
+    default: return 1;
+    }
+  case 0304: return 3; // CALL cc,nn
+  case 0305: return code == 0315 ? 3 : 1; // CALL nn : PUSH
+  case 0306: return 2; // ALU A,n
+  default: return 1;
+  }
+}
+
+// Return true if opcode uses (HL), replaced by (IX/IY+disp) when prefixed
+inline bool opcode_has_index(uint8_t code) {
+  switch (code & 0300) {
+  case 0000: return code == 0x34 || code == 0x35 || code == 0x36;
+  case 0100: return code != 0x76 && ((code & 07) == REG_M || (code & 070) == REG_M << 3);
+  case 0200: return (code & 07) == REG_M;
+  default: return false;
+  }
+}
+
+// Find size of instruction at address given its first byte, without decoding
+// operands; agrees with the size returned by dasm_instruction
+template <typename API>
+uint8_t dasm_length(uint16_t addr, uint8_t code) {
+  switch (code) {
+  case PREFIX_ED: {
+    // Only 16-bit LD (nn) has operand bytes: ED [01 --- 011]
+    const uint8_t next = API::read_byte(addr + 1);
+    return (next & 0307) == 0103 ? 4 : 2;
+  }
+  case PREFIX_IX:
+  case PREFIX_IY: {
+    const uint8_t next = API::read_byte(addr + 1);
+    if (next == PREFIX_IX || next == PREFIX_ED || next == PREFIX_IY) {
+      return 1; // prefix discarded
+    } else if (next == PREFIX_CB) {
+      return 4; // prefix, CB, disp, code
+    }
+    return 1 + opcode_length(next) + opcode_has_index(next);
+  }
+  default:
+    return opcode_length(code);
+  }
+}
+
+template <typename API>
+uint8_t dasm_length(uint16_t addr) {
+  return dasm_length<API>(addr, API::read_byte(addr));
+}
+
+// Forward range over instructions from start to end, inclusive
+// Instructions are decoded on dereference; stepping past one that wasn't
+// dereferenced only reads enough bytes to find its size
+template <typename API>
+class InstructionRange {
+  uint16_t start_;
+  uint16_t end_;
+
+public:
+  class Iterator {
+    uint16_t addr_;
+    uint16_t end_;
+    uint8_t size_ = 0; // 0 until instruction is sized
+    bool is_decoded_ = false;
+    bool is_done_;
+    Instruction inst_;
+
+  public:
+    Iterator(uint16_t addr, uint16_t end, bool is_done): addr_(addr), end_(end), is_done_(is_done) {}
+
+    uint16_t addr() const { return addr_; }
+
+    uint8_t size() {
+      if (size_ == 0) {
+        size_ = dasm_length<API>(addr_);
+      }
+      return size_;
+    }
+
+    const Instruction& operator*() {
+      if (!is_decoded_) {
+        inst_ = Instruction();
+        size_ = dasm_instruction<API>(inst_, addr_);
+        is_decoded_ = true;
+      }
+      return inst_;
+    }
+
+    const Instruction* operator->() { return &**this; }
+
+    Iterator& operator++() {
+      const uint8_t size = this->size();
+      // Stop after the instruction that overlaps end
+      if (uint16_t(end_ - addr_) < size) {
+        is_done_ = true;
+      }
+      addr_ += size;
+      size_ = 0;
+      is_decoded_ = false;
+      return *this;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return is_done_ == other.is_done_ && (is_done_ || addr_ == other.addr_);
+    }
+
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+  };
+
+  InstructionRange(uint16_t start, uint16_t end): start_(start), end_(end) {}
+
+  Iterator begin() const { return Iterator(start_, end_, false); }
+  Iterator end() const { return Iterator(end_, end_, true); }
+};
+
+// Bitmap of instruction starts seen within a sliding window of addresses
+// Lets backward paging step over known instructions without re-decoding
+template <uint8_t N = 16>
+class BoundaryMap {
+  static constexpr const uint16_t SPAN = N * 8;
+  uint16_t base_ = 0;
+  uint8_t starts_[N] = {}; // set if an instruction begins at address
+  uint8_t known_[N] = {}; // set if address was covered by a decoded instruction
+
+  static bool get(const uint8_t (&bits)[N], uint16_t offset) {
+    return (bits[offset / 8] & (1 << (offset % 8))) != 0;
+  }
+
+  static void put(uint8_t (&bits)[N], uint16_t offset, bool value) {
+    if (value) {
+      bits[offset / 8] |= 1 << (offset % 8);
+    } else {
+      bits[offset / 8] &= ~(1 << (offset % 8));
+    }
+  }
+
+  // Move window so that it contains addr, keeping what overlaps
+  void slide(uint16_t addr) {
+    uint16_t offset = addr - base_;
+    if (offset < SPAN) return;
+    if (offset < SPAN + SPAN / 2) {
+      // Shift upper half down when paging forward past the window
+      memmove(starts_, starts_ + N / 2, N - N / 2);
+      memmove(known_, known_ + N / 2, N - N / 2);
+      memset(starts_ + N - N / 2, 0, N / 2);
+      memset(known_ + N - N / 2, 0, N / 2);
+      base_ += (N / 2) * 8;
+      slide(addr);
+    } else {
+      // Otherwise start over with addr in the middle of the window
+      memset(starts_, 0, N);
+      memset(known_, 0, N);
+      base_ = (addr & ~7) - SPAN / 2;
+    }
+  }
+
+public:
+  void clear() {
+    memset(starts_, 0, N);
+    memset(known_, 0, N);
+  }
+
+  // Record instruction of given size starting at addr
+  void mark(uint16_t addr, uint8_t size) {
+    // Slide to last byte so trailing bytes aren't lost past end of window
+    slide(addr + size - 1);
+    for (uint8_t i = 0; i < size; ++i) {
+      uint16_t offset = uint16_t(addr + i - base_);
+      if (offset >= SPAN) break;
+      put(starts_, offset, i == 0);
+      put(known_, offset, true);
+    }
+  }
+
+  // Find start of up to count known instructions before addr
+  // Returns number found; start is left unchanged if none are known
+  uint8_t find_prev(uint16_t addr, uint8_t count, uint16_t& start) const {
+    uint16_t offset = addr - base_;
+    if (offset > SPAN) return 0;
+    uint8_t found = 0;
+    while (found < count && offset > 0) {
+      --offset;
+      if (!get(known_, offset)) break;
+      if (get(starts_, offset)) {
+        start = base_ + offset;
+        ++found;
+      }
+    }
+    return found;
+  }
+};
+
+// Boundaries of instructions printed by dasm_range
+template <typename API>
+BoundaryMap<>& dasm_boundaries() {
+  static BoundaryMap<> map;
+  return map;
+}
+
+// Return true if decoding from addr lands exactly on target
+// Sets count to the number of instructions decoded
+template <typename API>
+bool dasm_lands_on(uint16_t addr, uint16_t target, uint16_t& count) {
+  count = 0;
+  if (addr == target) return true;
+  InstructionRange<API> range(addr, target - 1);
+  auto it = range.begin();
+  for (; it != range.end(); ++it) ++count;
+  return it.addr() == target;
+}
+
+// Find start of the instruction count rows before addr
+template <typename API>
+uint16_t dasm_prev(uint16_t addr, uint8_t count) {
+  auto& map = dasm_boundaries<API>();
+  uint16_t start = addr;
+  uint8_t found = map.find_prev(addr, count, start);
+  // Memory may have been written since boundaries were recorded
+  uint16_t n;
+  if (found > 0 && !(dasm_lands_on<API>(start, addr, n) && n == found)) {
+    map.clear();
+    start = addr;
+    found = 0;
+  }
+  if (found < count) {
+    // Decode unknown code leading up to earliest known start, trying each
+    // alignment of a guess (Z80 instructions are at most 4 bytes)
+    const uint8_t left = count - found;
+    const uint16_t target = start;
+    const uint16_t guess = target - left * 4;
+    // Take the unaligned guess if nothing decodes cleanly into target
+    start = guess;
+    for (uint8_t skew = 0; skew < 4; ++skew) {
+      uint16_t pos = guess + skew;
+      if (dasm_lands_on<API>(pos, target, n)) {
+        // Skip instructions beyond the count wanted
+        InstructionRange<API> range(pos, target - 1);
+        auto it = range.begin();
+        for (; n > left; --n) ++it;
+        start = it.addr();
+        for (; it != range.end(); ++it) {
+          map.mark(it.addr(), it.size());
+        }
+        break;
+      }
+    }
+  }
+  return start;
+}
+
+// Print one row of data from addr to last, inclusive, returning bytes printed
+// Runs of a repeated byte are packed into DS count,byte
+// Rows are a listing for reading, not assembler input: they hold up to
+// COL_SIZE operands and quoted text, while the assembler takes DB/DW with two
+// operands and no DS, to keep Instruction at two operands
+template <typename API, uint8_t COL_SIZE = 8, uint8_t MIN_RUN = 8>
+uint16_t dasm_data(uint16_t addr, uint16_t last, uint8_t type) {
+  const uint16_t span = last - addr; // bytes available, minus one
+  const uint8_t data = API::read_byte(addr);
+  if (type != REGION_WORD) {
+    uint16_t run = 1;
+    while (run <= span && run < 0xFFFF && API::read_byte(addr + run) == data) {
+      ++run;
+    }
+    if (run >= MIN_RUN) {
+      print_pgm_table<API>(MNE_STR, MNE_DS);
+      API::print_string(" $");
+      format_hex16(API::print_char, run);
+      API::print_string(",$");
+      format_hex8(API::print_char, data);
+      return run;
+    }
+  }
+
+  if (type == REGION_WORD && span > 0) {
+    // Print words as operands so that pointers are shown by label
+    print_pgm_table<API>(MNE_STR, MNE_DW);
+    const uint16_t words = (span - 1) / 2; // words available, minus one
+    uint8_t count = words < COL_SIZE / 2 - 1 ? words + 1 : COL_SIZE / 2;
+    for (uint8_t i = 0; i < count; ++i) {
+      API::print_char(i == 0 ? ' ' : ',');
+      Operand op = read_imm_word<API>(addr + i * 2);
+      print_operand<API>(op);
+    }
+    return count * 2;
+  }
+
+  // Print bytes, quoting printable characters if text
+  print_pgm_table<API>(MNE_STR, MNE_DB);
+  const uint8_t cols = type == REGION_TEXT ? COL_SIZE * 2 : COL_SIZE;
+  uint8_t count = span < cols - 1 ? span + 1 : cols;
+  bool is_quoted = false;
+  for (uint8_t i = 0; i < count; ++i) {
+    uint8_t c = API::read_byte(addr + i);
+    bool is_text = type == REGION_TEXT && c >= ' ' && c < 0x7F && c != '"';
+    if (is_text != is_quoted && is_quoted) {
+      API::print_char('"');
+    }
+    if (!is_quoted || !is_text) {
+      API::print_char(i == 0 ? ' ' : ',');
+    }
+    if (is_text) {
+      if (!is_quoted) API::print_char('"');
+      API::print_char(c);
+    } else {
+      API::print_char('$');
+      format_hex8(API::print_char, c);
+    }
+    is_quoted = is_text;
+  }
+  if (is_quoted) {
+    API::print_char('"');
+  }
+  return count;
+}
+
 template <typename API, uint8_t MAX_ROWS = 24>
 uint16_t dasm_range(uint16_t addr, uint16_t end) {
+  // Walk labels in address order alongside addr
+  const Labels& labels = API::get_labels();
+  Labels::Cursor cursor = labels.seek(addr);
+  const char* label;
+  uint16_t label_addr;
   for (uint8_t i = 0; i < MAX_ROWS; ++i) {
-    // If address has label, print it
-    const char* label;
-    if (API::get_labels().get_name(addr, label)) {
-      API::print_string(label);
-      API::print_char(':');
-      API::newline();
+    // Skip labels inside previous row and print those at address
+    while (labels.get_cursor(cursor, label, label_addr) && label_addr <= addr) {
+      if (label_addr == addr) {
+        API::print_string(label);
+        API::print_char(':');
+        API::newline();
+      }
+      labels.next(cursor);
     }
 
     // Print instruction address
@@ -543,18 +882,36 @@ uint16_t dasm_range(uint16_t addr, uint16_t end) {
     format_hex16(API::print_char, addr);
     API::print_string("  ");
 
-    // Translate machine code to mnemonic and operands for printing
-    Instruction inst;
-    uint8_t size = dasm_instruction<API>(inst, addr);
-    if (inst.mnemonic != MNE_INVALID) {
+    // Print data regions as packed rows, limited to region and range
+    uint16_t size;
+    uint16_t region_end;
+    uint8_t type = API::get_regions().get_type(addr, region_end);
+    if (type != REGION_CODE) {
+      uint16_t last = uint16_t(region_end - addr) < uint16_t(end - addr) ? region_end : end;
+      // Break data row before next label
+      if (labels.get_cursor(cursor, label, label_addr) && label_addr <= last) {
+        last = label_addr - 1;
+      }
+      size = dasm_data<API>(addr, last, type);
+      API::newline();
+    } else {
+      // Translate machine code to mnemonic and operands for printing
+      Instruction inst;
+      size = dasm_instruction<API>(inst, addr);
       print_instruction<API>(inst);
+      API::newline();
+      dasm_boundaries<API>().mark(addr, size);
     }
-    API::newline();
 
     // Do while end does not overlap with opcode
     uint16_t prev = addr;
     addr += size;
     if (uint16_t(end - prev) < size) { break; }
+
+    // Start over from first label if address wrapped around
+    if (addr < prev) {
+      cursor = labels.seek(addr);
+    }
   }
   return addr;
 }
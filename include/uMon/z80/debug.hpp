@@ -0,0 +1,217 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Breakpoints, watchpoints and trace for code run by the emulator
+// Execute, read and write flags are bitmaps over 64K addresses, so each
+// instruction and each access through Debugger::Bus costs one bit test
+// A set flag breaks unless triggers on that address say otherwise; reads of
+// the instruction's own bytes are fetches and are not watched
+
+#pragma once
+
+#include "uMon/z80/emu.hpp"
+#include "uMon/z80/dasm.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Kinds of access with a flag bitmap
+enum {
+  WATCH_EXEC,
+  WATCH_READ,
+  WATCH_WRITE,
+  N_WATCH,
+};
+
+// Condition on a flagged address
+struct Trigger {
+  uint16_t addr;
+  uint8_t kind;
+  uint16_t skip; // hits to ignore before breaking
+  // Break only if true, or null to always break; registers are as of the
+  // access and data is the byte read, written, or the opcode executed
+  bool (*cond)(const CpuState& cpu, uint8_t data);
+};
+
+// State is static so Bus can test flags from read_byte/write_byte
+template <typename API, uint8_t N_TRACE = 16, uint8_t N_TRIGGERS = 8>
+class Debugger {
+  static uint8_t bits_[N_WATCH][0x2000];
+  static Trigger triggers_[N_TRIGGERS];
+  static uint8_t n_triggers_;
+  static uint16_t trace_[N_TRACE]; // PCs of recent instructions
+  static uint8_t trace_next_;
+  static uint8_t trace_size_;
+  static const CpuState* cpu_;
+  static uint16_t fetch_; // first byte of instruction being executed
+  static uint8_t fetch_size_;
+
+  static bool is_set(uint8_t kind, uint16_t addr) {
+    return (bits_[kind][addr >> 3] & (1 << (addr & 7))) != 0;
+  }
+
+  // Returns true if access to flagged address should break
+  static bool fire(uint8_t kind, uint16_t addr, uint8_t data) {
+    bool is_break = true;
+    for (uint8_t i = 0; i < n_triggers_; ++i) {
+      Trigger& trigger = triggers_[i];
+      if (trigger.kind != kind || trigger.addr != addr) continue;
+      if (is_break) is_break = false; // only triggers decide
+      if (trigger.cond != nullptr && !trigger.cond(*cpu_, data)) continue;
+      if (trigger.skip > 0) {
+        --trigger.skip;
+        continue;
+      }
+      is_break = true;
+      break;
+    }
+    if (is_break) {
+      hit_kind = kind;
+      hit_addr = addr;
+      hit_data = data;
+      is_hit = true;
+    }
+    return is_break;
+  }
+
+  static void on_data(uint8_t kind, uint16_t addr, uint8_t data) {
+    if (kind == WATCH_READ && uint16_t(addr - fetch_) < fetch_size_) return;
+    fire(kind, addr, data);
+  }
+
+public:
+  // Last break, valid after run returns RUN_BREAK
+  static bool is_hit;
+  static uint8_t hit_kind;
+  static uint16_t hit_addr;
+  static uint8_t hit_data;
+
+  // Memory bus with read and write flags; run Cpu<Debugger::Bus>
+  struct Bus : API {
+    static uint8_t read_byte(uint16_t addr) {
+      const uint8_t data = API::read_byte(addr);
+      if (is_set(WATCH_READ, addr)) on_data(WATCH_READ, addr, data);
+      return data;
+    }
+
+    static void write_byte(uint16_t addr, uint8_t data) {
+      if (is_set(WATCH_WRITE, addr)) on_data(WATCH_WRITE, addr, data);
+      API::write_byte(addr, data);
+    }
+  };
+
+  // Flag or unflag addresses from start to end, inclusive
+  static void set(uint8_t kind, uint16_t start, uint16_t end, bool is_on = true) {
+    for (uint16_t addr = start; ; ++addr) {
+      const uint8_t mask = 1 << (addr & 7);
+      uint8_t& byte = bits_[kind][addr >> 3];
+      byte = is_on ? byte | mask : byte & ~mask;
+      if (addr == end) break;
+    }
+  }
+
+  // Flag trigger address; returns false if no room
+  static bool add_trigger(const Trigger& trigger) {
+    if (n_triggers_ == N_TRIGGERS) return false;
+    triggers_[n_triggers_++] = trigger;
+    set(trigger.kind, trigger.addr, trigger.addr);
+    return true;
+  }
+
+  // Remove all flags, triggers and trace
+  static void clear() {
+    for (uint8_t kind = 0; kind < N_WATCH; ++kind) set(kind, 0, 0xFFFF, false);
+    n_triggers_ = 0;
+    trace_size_ = 0;
+    is_hit = false;
+  }
+
+  // Same as cpu.run, also stopping with RUN_BREAK on flags
+  // Executed flags break before the instruction, except where run resumes;
+  // read and write flags break after the instruction
+  template <typename Cpu>
+  static uint8_t run(Cpu& cpu, uint16_t until, uint32_t max_cycles) {
+    const uint32_t start = cpu.cycles;
+    cpu_ = &cpu;
+    is_hit = false;
+    for (bool is_first = true; ; is_first = false) {
+      const uint8_t status = cpu.run_status(until, start, max_cycles);
+      if (status != RUN_NONE) return status;
+      const uint16_t pc = cpu.pc;
+      if (cpu.is_halted) {
+        // Waiting on an interrupt after HALT; PC is not fetched
+        cpu.step();
+        if (is_hit) return RUN_BREAK;
+        continue;
+      }
+      if (!is_first && is_set(WATCH_EXEC, pc) && fire(WATCH_EXEC, pc, API::read_byte(pc))) {
+        return RUN_BREAK;
+      }
+      fetch_ = pc;
+      fetch_size_ = dasm_length<API>(pc);
+      cpu.step();
+      trace_[trace_next_] = pc;
+      trace_next_ = (trace_next_ + 1) % N_TRACE;
+      if (trace_size_ < N_TRACE) ++trace_size_;
+      if (is_hit) return RUN_BREAK;
+    }
+  }
+
+  // Print recent instructions, oldest first, as decoded from memory now
+  static void print_trace() {
+    for (uint8_t i = 0; i < trace_size_; ++i) {
+      const uint16_t addr = trace_[(trace_next_ + N_TRACE - trace_size_ + i) % N_TRACE];
+      API::print_char(' ');
+      format_hex16(API::print_char, addr);
+      API::print_string("  ");
+      Instruction inst;
+      dasm_instruction<API>(inst, addr);
+      print_instruction<API>(inst);
+      API::newline();
+    }
+  }
+};
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::bits_[N_WATCH][0x2000];
+
+template <typename API, uint8_t N, uint8_t M>
+Trigger Debugger<API, N, M>::triggers_[M];
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::n_triggers_;
+
+template <typename API, uint8_t N, uint8_t M>
+uint16_t Debugger<API, N, M>::trace_[N];
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::trace_next_;
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::trace_size_;
+
+template <typename API, uint8_t N, uint8_t M>
+const CpuState* Debugger<API, N, M>::cpu_;
+
+template <typename API, uint8_t N, uint8_t M>
+uint16_t Debugger<API, N, M>::fetch_;
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::fetch_size_;
+
+template <typename API, uint8_t N, uint8_t M>
+bool Debugger<API, N, M>::is_hit;
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::hit_kind;
+
+template <typename API, uint8_t N, uint8_t M>
+uint16_t Debugger<API, N, M>::hit_addr;
+
+template <typename API, uint8_t N, uint8_t M>
+uint8_t Debugger<API, N, M>::hit_data;
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,1126 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Z80 instruction-set emulator using API::read_byte/write_byte as its bus,
+// API::read_port/write_port for IN/OUT, and API::tick_devices for interrupts
+// Opcodes are split into the same octal fields [xx yyy zzz] and REG/PAIR/
+// COND/ALU/ROT encodings as the decoders in dasm.hpp
+// Timing is counted in T-states per instruction, as documented by Zilog;
+// undocumented DD/FD register halves and DDCB copies are supported
+// Optionally, common unprefixed and IX/IY opcodes are pre-decoded into basic
+// blocks of micro-ops that skip decoding when the block runs again; blocks
+// are short in call-heavy code, where finding the block costs about as much
+// as decoding saves
+
+#pragma once
+
+#include "uMon/z80/common.hpp"
+#include "uMon/z80/dasm.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Bits of register F
+enum {
+  FLAG_C = 0x01,
+  FLAG_N = 0x02,
+  FLAG_PV = 0x04,
+  FLAG_X = 0x08, // undocumented copy of result bit 3
+  FLAG_H = 0x10,
+  FLAG_Y = 0x20, // undocumented copy of result bit 5
+  FLAG_Z = 0x40,
+  FLAG_S = 0x80,
+};
+
+// Reason returned by Cpu::run
+enum {
+  RUN_UNTIL, // reached address
+  RUN_HALT, // halted with interrupts disabled
+  RUN_CYCLES, // spent cycle budget
+  RUN_BREAK, // hit breakpoint or watchpoint
+  RUN_NONE, // still running
+};
+
+// Complete register and interrupt state
+struct CpuState {
+  uint8_t a, f, b, c, d, e, h, l;
+  uint16_t ix, iy, sp, pc;
+  uint16_t af2, bc2, de2, hl2; // alternate set swapped in by EX AF,AF and EXX
+  uint8_t i, r, im;
+  bool iff1, iff2;
+  bool is_halted;
+  bool is_ei_delay; // no interrupt accepted until the instruction after EI
+  bool is_nmi;
+  bool is_irq;
+  uint8_t irq_data; // byte put on the bus by the interrupting device
+};
+
+// Kinds of pre-decoded instruction; others run through the interpreter
+enum {
+  UOP_EXEC, // interpret from memory
+  UOP_LD_R_R,
+  UOP_LD_R_N,
+  UOP_LD_R_M,
+  UOP_LD_M_R,
+  UOP_ALU_R,
+  UOP_ALU_N,
+  UOP_ALU_M,
+  UOP_INC_R,
+  UOP_DEC_R,
+  UOP_LD_RR_NN,
+  UOP_INC_RR,
+  UOP_DEC_RR,
+  UOP_JR,
+  UOP_DJNZ,
+  UOP_JP,
+  UOP_CALL,
+  UOP_RET,
+  UOP_ADD_HL,
+  // IX/IY forms with the prefix in y; the prefix is a second opcode fetch
+  UOP_LD_R_X,
+  UOP_LD_X_R,
+  UOP_ALU_X,
+  UOP_LD_X_NN,
+  UOP_INC_X,
+  UOP_DEC_X,
+  UOP_ADD_X,
+};
+
+struct MicroOp {
+  uint8_t kind;
+  uint8_t x; // destination register offset, pair, ALU op, or condition
+  uint8_t y; // source register offset or index prefix
+  uint8_t size;
+  uint16_t imm; // immediate or branch target
+};
+
+constexpr const uint8_t MAX_BLOCK_OPS = 16;
+
+// Direct-mapped cache of basic blocks keyed by start address
+// Bitmap of 64-byte lines covered by blocks filters writes cheaply
+template <uint8_t N_BLOCKS>
+struct BlockCache {
+  static_assert((N_BLOCKS & (N_BLOCKS - 1)) == 0, "N_BLOCKS must be a power of 2");
+
+  struct Block {
+    uint16_t start;
+    uint16_t end; // last byte of last instruction
+    uint8_t n_ops; // 0 if empty
+    MicroOp ops[MAX_BLOCK_OPS];
+  };
+
+  Block blocks[N_BLOCKS > 0 ? N_BLOCKS : 1];
+  uint8_t lines[N_BLOCKS > 0 ? 128 : 1];
+
+  BlockCache() { clear(); }
+
+  void clear() {
+    for (Block& block : blocks) block.n_ops = 0;
+    for (uint8_t& line : lines) line = 0;
+  }
+
+  Block& slot(uint16_t addr) { return blocks[(addr ^ addr >> 4) & (N_BLOCKS - 1)]; }
+
+  bool is_marked(uint16_t line) const { return (lines[line >> 3] & (1 << (line & 7))) != 0; }
+
+  void mark(uint16_t start, uint16_t end) {
+    for (uint16_t line = start >> 6; ; line = (line + 1) & 0x3FF) {
+      lines[line >> 3] |= 1 << (line & 7);
+      if (line == end >> 6) break;
+    }
+  }
+
+  // Empty blocks overlapping 64-byte line
+  void flush_line(uint16_t line) {
+    lines[line >> 3] &= ~(1 << (line & 7));
+    for (Block& block : blocks) {
+      const uint16_t first = block.start >> 6;
+      const uint16_t span = ((block.end >> 6) - first) & 0x3FF;
+      if (((line - first) & 0x3FF) <= span) block.n_ops = 0;
+    }
+  }
+
+  // Drop blocks that may contain addr; returns true if any line was flushed
+  bool invalidate(uint16_t addr) {
+    if (N_BLOCKS == 0 || !is_marked(addr >> 6)) return false;
+    flush_line(addr >> 6);
+    return true;
+  }
+};
+
+template <typename API, uint8_t N_BLOCKS = 0>
+class Cpu : public CpuState {
+public:
+  uint32_t cycles; // T-states since reset
+
+  Cpu() { reset(); }
+
+  void reset() {
+    static_cast<CpuState&>(*this) = CpuState();
+    a = f = 0xFF;
+    sp = 0xFFFF;
+    cycles = 0;
+    cache_.clear();
+  }
+
+  // Drop cached blocks after writing [start, end] other than through the Cpu
+  void invalidate(uint16_t start, uint16_t end) {
+    for (uint16_t line = start >> 6; ; line = (line + 1) & 0x3FF) {
+      cache_.invalidate(line << 6);
+      if (line == end >> 6) break;
+    }
+  }
+
+  uint16_t bc() const { return b << 8 | c; }
+  uint16_t de() const { return d << 8 | e; }
+  uint16_t hl() const { return h << 8 | l; }
+  uint16_t af() const { return a << 8 | f; }
+
+  // Latch maskable interrupt with data for IM 0 (RST only) or IM 2
+  void irq(uint8_t data = 0xFF) { is_irq = true; irq_data = data; }
+  void nmi() { is_nmi = true; }
+
+  // Execute one instruction or accept an interrupt, returning T-states
+  uint8_t step() {
+    uint8_t t;
+    if (is_nmi) {
+      is_nmi = false;
+      iff1 = false;
+      t = interrupt(0x66, 11);
+    } else if (is_irq && iff1 && !is_ei_delay) {
+      is_irq = false;
+      iff1 = iff2 = false;
+      if (im == 2) {
+        t = interrupt(read_word(i << 8 | irq_data), 19);
+      } else {
+        t = interrupt(im == 1 ? 0x38 : irq_data & 070, 13);
+      }
+    } else if (is_halted) {
+      refresh();
+      t = 4;
+    } else {
+      is_ei_delay = false;
+      t = execute(fetch_opcode(), 0);
+    }
+    tick(t);
+    return t;
+  }
+
+  // Reason to stop before the next instruction of a run started at start
+  // HALT with interrupts enabled keeps running so devices ticking through
+  // API::tick_devices can wake it; it stops only on the cycle budget
+  uint8_t run_status(uint16_t until, uint32_t start, uint32_t max_cycles) const {
+    if (pc == until) return RUN_UNTIL;
+    if (is_halted && !is_nmi && !iff1) return RUN_HALT;
+    if (cycles - start >= max_cycles) return RUN_CYCLES;
+    return RUN_NONE;
+  }
+
+  // Run until PC reaches until, the CPU halts with interrupts disabled, or
+  // max_cycles have passed
+  // Runs cached blocks when enabled; step() always interprets
+  uint8_t run(uint16_t until, uint32_t max_cycles) {
+    const uint32_t start = cycles;
+    for (;;) {
+      const uint8_t status = run_status(until, start, max_cycles);
+      if (status != RUN_NONE) return status;
+      if (N_BLOCKS > 0 && !is_halted && !is_interrupt_ready()) {
+        run_block(until, start, max_cycles);
+      } else {
+        step();
+      }
+    }
+  }
+
+private:
+  typedef typename BlockCache<N_BLOCKS>::Block Block;
+  BlockCache<N_BLOCKS> cache_;
+  bool is_flushed_; // set when a write empties cached blocks
+
+  uint8_t in(uint16_t port) { return API::read_port(port); }
+  void out(uint16_t port, uint8_t data) { API::write_port(port, data); }
+
+  void tick(uint8_t t) {
+    cycles += t;
+    uint8_t data;
+    if (API::tick_devices(t, data)) irq(data);
+  }
+
+  uint8_t read(uint16_t addr) { return API::read_byte(addr); }
+  void write(uint16_t addr, uint8_t data) {
+    API::write_byte(addr, data);
+    if (cache_.invalidate(addr)) is_flushed_ = true;
+  }
+
+  uint16_t read_word(uint16_t addr) {
+    uint8_t lsb = read(addr);
+    return read(addr + 1) << 8 | lsb;
+  }
+
+  void write_word(uint16_t addr, uint16_t data) {
+    write(addr, data & 0xFF);
+    write(addr + 1, data >> 8);
+  }
+
+  // Increment low 7 bits of R for each opcode fetch
+  void refresh() { r = (r & 0x80) | ((r + 1) & 0x7F); }
+
+  uint8_t fetch() { return read(pc++); }
+  uint8_t fetch_opcode() { refresh(); return fetch(); }
+
+  uint16_t fetch_word() {
+    uint8_t lsb = fetch();
+    return fetch() << 8 | lsb;
+  }
+
+  void push(uint16_t data) {
+    write(--sp, data >> 8);
+    write(--sp, data & 0xFF);
+  }
+
+  uint16_t pop() {
+    uint8_t lsb = read(sp++);
+    return read(sp++) << 8 | lsb;
+  }
+
+  uint8_t interrupt(uint16_t addr, uint8_t t) {
+    is_halted = false;
+    refresh();
+    push(pc);
+    pc = addr;
+    return t;
+  }
+
+  // HL, or IX/IY in its place when prefixed
+  uint16_t get_hl(uint8_t prefix) const {
+    return prefix == PREFIX_IX ? ix : prefix == PREFIX_IY ? iy : hl();
+  }
+
+  void set_hl(uint8_t prefix, uint16_t data) {
+    if (prefix == PREFIX_IX) {
+      ix = data;
+    } else if (prefix == PREFIX_IY) {
+      iy = data;
+    } else {
+      h = data >> 8;
+      l = data & 0xFF;
+    }
+  }
+
+  // Register other than (HL), with H/L as IXH/IXL or IYH/IYL when prefixed
+  uint8_t get_reg(uint8_t reg, uint8_t prefix) const {
+    switch (reg) {
+    case REG_B: return b;
+    case REG_C: return c;
+    case REG_D: return d;
+    case REG_E: return e;
+    case REG_H: return get_hl(prefix) >> 8;
+    case REG_L: return get_hl(prefix) & 0xFF;
+    default: return a;
+    }
+  }
+
+  void set_reg(uint8_t reg, uint8_t prefix, uint8_t data) {
+    switch (reg) {
+    case REG_B: b = data; break;
+    case REG_C: c = data; break;
+    case REG_D: d = data; break;
+    case REG_E: e = data; break;
+    case REG_H: set_hl(prefix, (get_hl(prefix) & 0x00FF) | data << 8); break;
+    case REG_L: set_hl(prefix, (get_hl(prefix) & 0xFF00) | data); break;
+    default: a = data; break;
+    }
+  }
+
+  uint16_t get_pair(uint8_t pair, uint8_t prefix) const {
+    switch (pair) {
+    case PAIR_BC: return bc();
+    case PAIR_DE: return de();
+    case PAIR_HL: return get_hl(prefix);
+    default: return sp;
+    }
+  }
+
+  void set_pair(uint8_t pair, uint8_t prefix, uint16_t data) {
+    switch (pair) {
+    case PAIR_BC: b = data >> 8; c = data & 0xFF; break;
+    case PAIR_DE: d = data >> 8; e = data & 0xFF; break;
+    case PAIR_HL: set_hl(prefix, data); break;
+    default: sp = data; break;
+    }
+  }
+
+  // Address of (HL), or of (IX/IY+d) after fetching d
+  uint16_t mem_addr(uint8_t prefix) {
+    return prefix == 0 ? hl() : get_hl(prefix) + int8_t(fetch());
+  }
+
+  bool cond(uint8_t cc) const {
+    switch (cc) {
+    case COND_NZ: return (f & FLAG_Z) == 0;
+    case COND_Z: return (f & FLAG_Z) != 0;
+    case COND_NC: return (f & FLAG_C) == 0;
+    case COND_C: return (f & FLAG_C) != 0;
+    case COND_PO: return (f & FLAG_PV) == 0;
+    case COND_PE: return (f & FLAG_PV) != 0;
+    case COND_P: return (f & FLAG_S) == 0;
+    default: return (f & FLAG_S) != 0;
+    }
+  }
+
+  // ==========================================================================
+  // Flag Arithmetic
+  // ==========================================================================
+
+  static uint8_t flags_sz(uint8_t v) {
+    return (v & (FLAG_S | FLAG_X | FLAG_Y)) | (v == 0 ? FLAG_Z : 0);
+  }
+
+  static uint8_t flags_szp(uint8_t v) {
+    uint8_t p = v ^ v >> 4;
+    p ^= p >> 2;
+    p ^= p >> 1;
+    return flags_sz(v) | ((p & 1) == 0 ? FLAG_PV : 0);
+  }
+
+  void add_a(uint8_t v, uint8_t carry) {
+    const uint16_t res = a + v + carry;
+    f = flags_sz(res) | ((a ^ v ^ res) & FLAG_H)
+      | (((a ^ ~v) & (a ^ res) & 0x80) >> 5) | (res >> 8);
+    a = res;
+  }
+
+  uint8_t sub_a(uint8_t v, uint8_t carry) {
+    const uint16_t res = a - v - carry;
+    f = flags_sz(res) | ((a ^ v ^ res) & FLAG_H)
+      | (((a ^ v) & (a ^ res) & 0x80) >> 5) | FLAG_N | ((res >> 8) & FLAG_C);
+    return res;
+  }
+
+  void alu(uint8_t op, uint8_t v) {
+    switch (op) {
+    case ALU_ADD: add_a(v, 0); break;
+    case ALU_ADC: add_a(v, f & FLAG_C); break;
+    case ALU_SUB: a = sub_a(v, 0); break;
+    case ALU_SBC: a = sub_a(v, f & FLAG_C); break;
+    case ALU_AND: a &= v; f = flags_szp(a) | FLAG_H; break;
+    case ALU_XOR: a ^= v; f = flags_szp(a); break;
+    case ALU_OR: a |= v; f = flags_szp(a); break;
+    default:
+      // CP takes X/Y from the operand
+      sub_a(v, 0);
+      f = (f & ~(FLAG_X | FLAG_Y)) | (v & (FLAG_X | FLAG_Y));
+      break;
+    }
+  }
+
+  uint8_t inc(uint8_t v) {
+    const uint8_t res = v + 1;
+    f = (f & FLAG_C) | flags_sz(res) | ((res & 0x0F) == 0 ? FLAG_H : 0) | (res == 0x80 ? FLAG_PV : 0);
+    return res;
+  }
+
+  uint8_t dec(uint8_t v) {
+    const uint8_t res = v - 1;
+    f = (f & FLAG_C) | FLAG_N | flags_sz(res) | ((v & 0x0F) == 0 ? FLAG_H : 0) | (res == 0x7F ? FLAG_PV : 0);
+    return res;
+  }
+
+  uint16_t add16(uint16_t x, uint16_t v) {
+    const uint32_t res = uint32_t(x) + v;
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (((x ^ v ^ res) >> 8) & FLAG_H)
+      | ((res >> 8) & (FLAG_X | FLAG_Y)) | (res >> 16);
+    return res;
+  }
+
+  // 16-bit ADC/SBC to HL
+  void adc_sbc16(uint16_t v, bool is_sbc) {
+    const uint16_t x = hl();
+    const uint32_t res = is_sbc ? uint32_t(x) - v - (f & FLAG_C) : uint32_t(x) + v + (f & FLAG_C);
+    const uint16_t ov = is_sbc ? (x ^ v) & (x ^ res) : (x ^ ~v) & (x ^ res);
+    f = ((res >> 8) & (FLAG_S | FLAG_X | FLAG_Y)) | ((res & 0xFFFF) == 0 ? FLAG_Z : 0)
+      | (((x ^ v ^ res) >> 8) & FLAG_H) | ((ov >> 13) & FLAG_PV)
+      | (is_sbc ? FLAG_N : 0) | ((res >> 16) & FLAG_C);
+    set_hl(0, res);
+  }
+
+  // RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF: [00 --- 111]
+  void misc_af(uint8_t op) {
+    const uint8_t keep = f & (FLAG_S | FLAG_Z | FLAG_PV);
+    uint8_t carry = f & FLAG_C;
+    switch (op) {
+    case 0: carry = a >> 7; a = a << 1 | carry; break;
+    case 1: carry = a & 1; a = a >> 1 | carry << 7; break;
+    case 2: { const uint8_t out = a >> 7; a = a << 1 | carry; carry = out; break; }
+    case 3: { const uint8_t out = a & 1; a = a >> 1 | carry << 7; carry = out; break; }
+    case 4: {
+      uint8_t diff = 0;
+      if ((f & FLAG_H) || (a & 0x0F) > 9) diff |= 0x06;
+      if (carry || a > 0x99) { diff |= 0x60; carry = FLAG_C; }
+      const bool is_sub = (f & FLAG_N) != 0;
+      const uint8_t half = is_sub
+        ? ((f & FLAG_H) && (a & 0x0F) < 6 ? FLAG_H : 0)
+        : ((a & 0x0F) > 9 ? FLAG_H : 0);
+      a = is_sub ? a - diff : a + diff;
+      f = flags_szp(a) | half | (f & FLAG_N) | carry;
+      return;
+    }
+    case 5:
+      a = ~a;
+      f = keep | (f & FLAG_C) | FLAG_H | FLAG_N | (a & (FLAG_X | FLAG_Y));
+      return;
+    case 6: carry = FLAG_C; break;
+    default:
+      f = keep | (a & (FLAG_X | FLAG_Y)) | (carry ? FLAG_H : FLAG_C);
+      return;
+    }
+    f = keep | (a & (FLAG_X | FLAG_Y)) | carry;
+  }
+
+  // CB-prefix rotate and shift
+  uint8_t rot(uint8_t op, uint8_t v) {
+    uint8_t carry;
+    uint8_t res;
+    switch (op) {
+    case ROT_RLC: carry = v >> 7; res = v << 1 | carry; break;
+    case ROT_RRC: carry = v & 1; res = v >> 1 | carry << 7; break;
+    case ROT_RL: carry = v >> 7; res = v << 1 | (f & FLAG_C); break;
+    case ROT_RR: carry = v & 1; res = v >> 1 | (f & FLAG_C) << 7; break;
+    case ROT_SLA: carry = v >> 7; res = v << 1; break;
+    case ROT_SRA: carry = v & 1; res = v >> 1 | (v & 0x80); break;
+    case ROT_SL1: carry = v >> 7; res = v << 1 | 1; break;
+    default: carry = v & 1; res = v >> 1; break;
+    }
+    f = flags_szp(res) | carry;
+    return res;
+  }
+
+  void bit(uint8_t n, uint8_t v) {
+    const uint8_t res = v & (1 << n);
+    f = (f & FLAG_C) | FLAG_H | (v & (FLAG_X | FLAG_Y)) | (res & FLAG_S) | (res == 0 ? FLAG_Z | FLAG_PV : 0);
+  }
+
+  // ==========================================================================
+  // Execution
+  // ==========================================================================
+
+  // Execute CB op on v, returning result to write back (unused for BIT)
+  uint8_t execute_cb_op(uint8_t code, uint8_t v) {
+    const uint8_t y = (code & 070) >> 3;
+    switch (code >> 6) {
+    case CB_ROT: return rot(y, v);
+    case CB_BIT: bit(y, v); return v;
+    case CB_RES: return v & ~(1 << y);
+    default: return v | (1 << y);
+    }
+  }
+
+  // CB [-- --- zzz] or DD/FD CB d [-- --- zzz]
+  uint8_t execute_cb(uint8_t prefix) {
+    if (prefix != 0) {
+      const uint16_t addr = mem_addr(prefix);
+      const uint8_t code = fetch();
+      const uint8_t res = execute_cb_op(code, read(addr));
+      if ((code >> 6) == CB_BIT) return 16;
+      write(addr, res);
+      // NOTE undocumented ops also copy the result to a register
+      const uint8_t reg = code & 07;
+      if (reg != REG_M) set_reg(reg, 0, res);
+      return 19;
+    }
+    const uint8_t code = fetch_opcode();
+    const uint8_t reg = code & 07;
+    if (reg == REG_M) {
+      const uint16_t addr = hl();
+      const uint8_t res = execute_cb_op(code, read(addr));
+      if ((code >> 6) == CB_BIT) return 12;
+      write(addr, res);
+      return 15;
+    }
+    set_reg(reg, 0, execute_cb_op(code, get_reg(reg, 0)));
+    return 8;
+  }
+
+  // ED [10 1-- 0--]: LDI, CPI, INI, OUTI and decrementing/repeating forms
+  uint8_t execute_block(uint8_t code) {
+    const uint8_t op = code & 03;
+    const bool is_dec = (code & 010) != 0;
+    const bool is_repeat = (code & 020) != 0;
+    const uint16_t step = is_dec ? 0xFFFF : 1;
+    bool is_done = true;
+    switch (op) {
+    case 0: { // LDI
+      const uint8_t v = read(hl());
+      write(de(), v);
+      set_pair(PAIR_HL, 0, hl() + step);
+      set_pair(PAIR_DE, 0, de() + step);
+      set_pair(PAIR_BC, 0, bc() - 1);
+      const uint8_t n = v + a;
+      f = (f & (FLAG_S | FLAG_Z | FLAG_C)) | (bc() != 0 ? FLAG_PV : 0) | (n & FLAG_X) | ((n << 4) & FLAG_Y);
+      is_done = bc() == 0;
+      break;
+    }
+    case 1: { // CPI
+      const uint8_t v = read(hl());
+      const uint8_t res = a - v;
+      set_pair(PAIR_HL, 0, hl() + step);
+      set_pair(PAIR_BC, 0, bc() - 1);
+      f = (f & FLAG_C) | FLAG_N | (res & FLAG_S) | (res == 0 ? FLAG_Z : 0)
+        | ((a ^ v ^ res) & FLAG_H) | (bc() != 0 ? FLAG_PV : 0);
+      const uint8_t n = res - ((f & FLAG_H) ? 1 : 0);
+      f |= (n & FLAG_X) | ((n << 4) & FLAG_Y);
+      is_done = bc() == 0 || res == 0;
+      break;
+    }
+    case 2: // INI
+      write(hl(), in(bc()));
+      set_pair(PAIR_HL, 0, hl() + step);
+      f = flags_sz(--b) | FLAG_N;
+      is_done = b == 0;
+      break;
+    default: { // OUTI
+      const uint8_t v = read(hl());
+      out(--b << 8 | c, v);
+      set_pair(PAIR_HL, 0, hl() + step);
+      f = flags_sz(b) | FLAG_N;
+      is_done = b == 0;
+      break;
+    }
+    }
+    if (is_repeat && !is_done) {
+      pc -= 2;
+      return 21;
+    }
+    return 16;
+  }
+
+  // ED [-- --- ---]
+  uint8_t execute_ed(uint8_t code) {
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t pair = y >> 1;
+    const bool q = (y & 1) != 0;
+    if ((code & 0300) == 0200 && (code & 044) == 040) {
+      return execute_block(code);
+    }
+    if ((code & 0300) != 0100) {
+      return 8; // NOTE undefined; acts as 2 NOPs
+    }
+    switch (code & 07) {
+    case 0: { // IN r,(C)
+      const uint8_t v = in(bc());
+      f = (f & FLAG_C) | flags_szp(v);
+      if (y != REG_M) set_reg(y, 0, v);
+      return 12;
+    }
+    case 1: // OUT (C),r
+      out(bc(), y == REG_M ? 0 : get_reg(y, 0));
+      return 12;
+    case 2:
+      adc_sbc16(get_pair(pair, 0), !q);
+      return 15;
+    case 3: {
+      const uint16_t addr = fetch_word();
+      if (q) {
+        set_pair(pair, 0, read_word(addr));
+      } else {
+        write_word(addr, get_pair(pair, 0));
+      }
+      return 20;
+    }
+    case 4: { // NEG
+      const uint8_t v = a;
+      a = 0;
+      a = sub_a(v, 0);
+      return 8;
+    }
+    case 5: // RETN/RETI
+      pc = pop();
+      iff1 = iff2;
+      return 14;
+    case 6: { // IM
+      const uint8_t mode = y & 03;
+      im = mode > 0 ? mode - 1 : 0;
+      return 8;
+    }
+    default:
+      switch (y) {
+      case 0: i = a; return 9;
+      case 1: r = a; return 9;
+      case 2:
+      case 3:
+        a = y == 2 ? i : r;
+        f = (f & FLAG_C) | flags_sz(a) | (iff2 ? FLAG_PV : 0);
+        return 9;
+      case 4: // RRD
+      case 5: { // RLD
+        const uint8_t v = read(hl());
+        if (y == 4) {
+          write(hl(), a << 4 | v >> 4);
+          a = (a & 0xF0) | (v & 0x0F);
+        } else {
+          write(hl(), v << 4 | (a & 0x0F));
+          a = (a & 0xF0) | v >> 4;
+        }
+        f = (f & FLAG_C) | flags_szp(a);
+        return 18;
+      }
+      default:
+        return 8;
+      }
+    }
+  }
+
+  // [00 --- ---]
+  uint8_t execute_lo(uint8_t code, uint8_t prefix) {
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t pair = y >> 1;
+    const bool q = (y & 1) != 0;
+    // (IX/IY+d) adds displacement fetch and address calculation
+    const uint8_t disp_t = prefix != 0 ? 8 : 0;
+    switch (code & 07) {
+    case 0:
+      switch (y) {
+      case 0: return 4; // NOP
+      case 1: { // EX AF,AF
+        const uint16_t tmp = af();
+        a = af2 >> 8;
+        f = af2 & 0xFF;
+        af2 = tmp;
+        return 4;
+      }
+      case 2: { // DJNZ
+        const int8_t disp = fetch();
+        if (--b == 0) return 8;
+        pc += disp;
+        return 13;
+      }
+      default: { // JR (cc)
+        const int8_t disp = fetch();
+        if (y > 3 && !cond(y - 4)) return 7;
+        pc += disp;
+        return 12;
+      }
+      }
+    case 1:
+      if (q) {
+        set_hl(prefix, add16(get_hl(prefix), get_pair(pair, prefix)));
+        return 11;
+      }
+      set_pair(pair, prefix, fetch_word());
+      return 10;
+    case 2:
+      switch (y) {
+      case 0: write(bc(), a); return 7;
+      case 1: a = read(bc()); return 7;
+      case 2: write(de(), a); return 7;
+      case 3: a = read(de()); return 7;
+      case 4: write_word(fetch_word(), get_hl(prefix)); return 16;
+      case 5: set_hl(prefix, read_word(fetch_word())); return 16;
+      case 6: write(fetch_word(), a); return 13;
+      default: a = read(fetch_word()); return 13;
+      }
+    case 3:
+      set_pair(pair, prefix, get_pair(pair, prefix) + (q ? -1 : 1));
+      return 6;
+    case 4:
+    case 5: {
+      const bool is_dec = (code & 01) != 0;
+      if (y == REG_M) {
+        const uint16_t addr = mem_addr(prefix);
+        const uint8_t v = read(addr);
+        write(addr, is_dec ? dec(v) : inc(v));
+        return 11 + disp_t;
+      }
+      const uint8_t v = get_reg(y, prefix);
+      set_reg(y, prefix, is_dec ? dec(v) : inc(v));
+      return 4;
+    }
+    case 6:
+      if (y == REG_M) {
+        const uint16_t addr = mem_addr(prefix);
+        write(addr, fetch());
+        // NOTE n is fetched alongside d
+        return prefix != 0 ? 15 : 10;
+      }
+      set_reg(y, prefix, fetch());
+      return 7;
+    default:
+      misc_af(y);
+      return 4;
+    }
+  }
+
+  // [11 --- ---]
+  uint8_t execute_hi(uint8_t code, uint8_t prefix) {
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t pair = y >> 1;
+    const bool q = (y & 1) != 0;
+    switch (code & 07) {
+    case 0: // RET cc
+      if (!cond(y)) return 5;
+      pc = pop();
+      return 11;
+    case 1:
+      if (!q) { // POP
+        const uint16_t data = pop();
+        if (pair == PAIR_SP) {
+          a = data >> 8;
+          f = data & 0xFF;
+        } else {
+          set_pair(pair, prefix, data);
+        }
+        return 10;
+      }
+      switch (pair) {
+      case 0: pc = pop(); return 10; // RET
+      case 1: { // EXX
+        const uint16_t tmp_bc = bc(), tmp_de = de(), tmp_hl = hl();
+        set_pair(PAIR_BC, 0, bc2);
+        set_pair(PAIR_DE, 0, de2);
+        set_pair(PAIR_HL, 0, hl2);
+        bc2 = tmp_bc;
+        de2 = tmp_de;
+        hl2 = tmp_hl;
+        return 4;
+      }
+      case 2: pc = get_hl(prefix); return 4; // JP (HL)
+      default: sp = get_hl(prefix); return 6; // LD SP,HL
+      }
+    case 2: { // JP cc,nn
+      const uint16_t addr = fetch_word();
+      if (cond(y)) pc = addr;
+      return 10;
+    }
+    case 3:
+      switch (y) {
+      case 0: pc = fetch_word(); return 10;
+      case 1: return execute_cb(prefix);
+      case 2: out(a << 8 | fetch(), a); return 11;
+      case 3: a = in(a << 8 | fetch()); return 11;
+      case 4: { // EX (SP),HL
+        const uint16_t tmp = read_word(sp);
+        write_word(sp, get_hl(prefix));
+        set_hl(prefix, tmp);
+        return 19;
+      }
+      case 5: { // EX DE,HL
+        const uint16_t tmp = de();
+        set_pair(PAIR_DE, 0, hl());
+        set_pair(PAIR_HL, 0, tmp);
+        return 4;
+      }
+      case 6: iff1 = iff2 = false; return 4;
+      default: iff1 = iff2 = true; is_ei_delay = true; return 4;
+      }
+    case 4: { // CALL cc,nn
+      const uint16_t addr = fetch_word();
+      if (!cond(y)) return 10;
+      push(pc);
+      pc = addr;
+      return 17;
+    }
+    case 5:
+      if (!q) { // PUSH
+        push(pair == PAIR_SP ? af() : get_pair(pair, prefix));
+        return 11;
+      }
+      switch (pair) {
+      case 0: { // CALL nn
+        const uint16_t addr = fetch_word();
+        push(pc);
+        pc = addr;
+        return 17;
+      }
+      case 2: return execute_ed(fetch_opcode());
+      default: return 4 + execute(fetch_opcode(), code);
+      }
+    case 6:
+      alu(y, fetch());
+      return 7;
+    default: // RST
+      push(pc);
+      pc = y << 3;
+      return 11;
+    }
+  }
+
+  // ==========================================================================
+  // Block Cache
+  // ==========================================================================
+
+  // Registers are addressed by offset into CpuState in pre-decoded ops
+  static uint8_t reg_offset(uint8_t reg) {
+    switch (reg) {
+    case REG_B: return offsetof(CpuState, b);
+    case REG_C: return offsetof(CpuState, c);
+    case REG_D: return offsetof(CpuState, d);
+    case REG_E: return offsetof(CpuState, e);
+    case REG_H: return offsetof(CpuState, h);
+    case REG_L: return offsetof(CpuState, l);
+    default: return offsetof(CpuState, a);
+    }
+  }
+
+  uint8_t& reg_at(uint8_t offset) {
+    return reinterpret_cast<uint8_t*>(static_cast<CpuState*>(this))[offset];
+  }
+
+  // Pre-decode instruction at addr, returning true if it ends the block
+  bool decode_uop(MicroOp& op, uint16_t addr) {
+    const uint8_t code = API::read_byte(addr);
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t z = code & 07;
+    const uint8_t pair = y >> 1;
+    const bool q = (y & 1) != 0;
+    op.kind = UOP_EXEC;
+    op.x = y;
+    op.y = z;
+    op.size = dasm_length<API>(addr, code);
+    op.imm = API::read_byte(addr + 1) | API::read_byte(addr + 2) << 8;
+    const uint16_t rel = addr + 2 + int8_t(op.imm & 0xFF);
+    if (code == PREFIX_IX || code == PREFIX_IY) {
+      decode_index_uop(op, addr, code);
+      return false;
+    }
+    switch (code >> 6) {
+    case 0:
+      switch (z) {
+      case 0:
+        if (y < 2) return false;
+        op.kind = y == 2 ? UOP_DJNZ : UOP_JR;
+        op.x = y == 3 ? COND_INVALID : y - 4;
+        op.imm = rel;
+        return true;
+      case 1:
+        op.kind = q ? UOP_ADD_HL : UOP_LD_RR_NN;
+        op.x = pair;
+        return false;
+      case 3:
+        op.kind = q ? UOP_DEC_RR : UOP_INC_RR;
+        op.x = pair;
+        return false;
+      case 4:
+      case 5:
+        if (y != REG_M) {
+          op.kind = z == 4 ? UOP_INC_R : UOP_DEC_R;
+          op.x = reg_offset(y);
+        }
+        return false;
+      case 6:
+        if (y != REG_M) {
+          op.kind = UOP_LD_R_N;
+          op.x = reg_offset(y);
+        }
+        return false;
+      default:
+        return false;
+      }
+    case 1:
+      if (code == 0x76) return true; // HALT
+      op.kind = y == REG_M ? UOP_LD_M_R : z == REG_M ? UOP_LD_R_M : UOP_LD_R_R;
+      op.x = reg_offset(y);
+      op.y = reg_offset(z);
+      return false;
+    case 2:
+      op.kind = z == REG_M ? UOP_ALU_M : UOP_ALU_R;
+      op.y = reg_offset(z);
+      return false;
+    default:
+      switch (z) {
+      case 0:
+        op.kind = UOP_RET;
+        return true;
+      case 1:
+        if (y == 1) {
+          op.kind = UOP_RET;
+          op.x = COND_INVALID;
+        }
+        return y == 1 || y == 5; // RET, JP (HL)
+      case 2:
+        op.kind = UOP_JP;
+        return true;
+      case 3:
+        if (y == 0) {
+          op.kind = UOP_JP;
+          op.x = COND_INVALID;
+        }
+        return y == 0;
+      case 4:
+        op.kind = UOP_CALL;
+        return true;
+      case 5:
+        if (y == 1) {
+          op.kind = UOP_CALL;
+          op.x = COND_INVALID;
+        }
+        return y == 1;
+      case 6:
+        op.kind = UOP_ALU_N;
+        return false;
+      default:
+        return true; // RST
+      }
+    }
+  }
+
+  // Pre-decode (IX/IY+d) loads and ALU ops and IX/IY pair ops; others are
+  // interpreted, and any that branch end the block when PC moves elsewhere
+  void decode_index_uop(MicroOp& op, uint16_t addr, uint8_t prefix) {
+    const uint8_t code = API::read_byte(addr + 1);
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t z = code & 07;
+    const uint8_t disp = API::read_byte(addr + 2);
+    op.y = prefix;
+    if (code == 0x21) {
+      op.kind = UOP_LD_X_NN;
+      op.imm = disp | API::read_byte(addr + 3) << 8;
+    } else if (code == 0x23 || code == 0x2B) {
+      op.kind = code == 0x23 ? UOP_INC_X : UOP_DEC_X;
+    } else if ((code & 0317) == 0011) {
+      op.kind = UOP_ADD_X;
+      op.x = y >> 1;
+    } else if (code >> 6 == 1 && (y == REG_M) != (z == REG_M)) {
+      // H/L are never IXH/IXL alongside (IX+d)
+      op.kind = y == REG_M ? UOP_LD_X_R : UOP_LD_R_X;
+      op.x = reg_offset(y == REG_M ? z : y);
+      op.imm = disp;
+    } else if (code >> 6 == 2 && z == REG_M) {
+      op.kind = UOP_ALU_X;
+      op.x = y;
+      op.imm = disp;
+    }
+  }
+
+  Block& find_block(uint16_t addr) {
+    Block& block = cache_.slot(addr);
+    if (block.n_ops != 0 && block.start == addr) return block;
+    block.start = addr;
+    block.n_ops = 0;
+    for (;;) {
+      MicroOp& op = block.ops[block.n_ops++];
+      const bool is_end = decode_uop(op, addr);
+      addr += op.size;
+      if (is_end || block.n_ops == MAX_BLOCK_OPS) break;
+    }
+    block.end = addr - 1;
+    cache_.mark(block.start, block.end);
+    return block;
+  }
+
+  bool is_taken(const MicroOp& op) const {
+    return op.x == COND_INVALID || cond(op.x);
+  }
+
+  // Execute op at PC, advancing PC to next unless op branches
+  uint8_t execute_uop(const MicroOp& op, uint16_t next) {
+    if (op.kind == UOP_EXEC) {
+      return execute(fetch_opcode(), 0);
+    }
+    refresh();
+    if (op.kind >= UOP_LD_R_X) refresh();
+    pc = next;
+    switch (op.kind) {
+    case UOP_LD_R_R: reg_at(op.x) = reg_at(op.y); return 4;
+    case UOP_LD_R_N: reg_at(op.x) = op.imm & 0xFF; return 7;
+    case UOP_LD_R_M: reg_at(op.x) = read(hl()); return 7;
+    case UOP_LD_M_R: write(hl(), reg_at(op.y)); return 7;
+    case UOP_ALU_R: alu(op.x, reg_at(op.y)); return 4;
+    case UOP_ALU_N: alu(op.x, op.imm & 0xFF); return 7;
+    case UOP_ALU_M: alu(op.x, read(hl())); return 7;
+    case UOP_INC_R: reg_at(op.x) = inc(reg_at(op.x)); return 4;
+    case UOP_DEC_R: reg_at(op.x) = dec(reg_at(op.x)); return 4;
+    case UOP_LD_RR_NN: set_pair(op.x, 0, op.imm); return 10;
+    case UOP_INC_RR: set_pair(op.x, 0, get_pair(op.x, 0) + 1); return 6;
+    case UOP_DEC_RR: set_pair(op.x, 0, get_pair(op.x, 0) - 1); return 6;
+    case UOP_ADD_HL: set_hl(0, add16(hl(), get_pair(op.x, 0))); return 11;
+    case UOP_LD_R_X: reg_at(op.x) = read(get_hl(op.y) + int8_t(op.imm)); return 19;
+    case UOP_LD_X_R: write(get_hl(op.y) + int8_t(op.imm), reg_at(op.x)); return 19;
+    case UOP_ALU_X: alu(op.x, read(get_hl(op.y) + int8_t(op.imm))); return 19;
+    case UOP_LD_X_NN: set_hl(op.y, op.imm); return 14;
+    case UOP_INC_X: set_hl(op.y, get_hl(op.y) + 1); return 10;
+    case UOP_DEC_X: set_hl(op.y, get_hl(op.y) - 1); return 10;
+    case UOP_ADD_X: set_hl(op.y, add16(get_hl(op.y), get_pair(op.x, op.y))); return 15;
+    case UOP_JR:
+      if (!is_taken(op)) return 7;
+      pc = op.imm;
+      return 12;
+    case UOP_DJNZ:
+      if (--b == 0) return 8;
+      pc = op.imm;
+      return 13;
+    case UOP_JP:
+      if (is_taken(op)) pc = op.imm;
+      return 10;
+    case UOP_CALL:
+      if (!is_taken(op)) return 10;
+      push(next);
+      pc = op.imm;
+      return 17;
+    default: // UOP_RET
+      if (!is_taken(op)) return 5;
+      pc = pop();
+      return op.x == COND_INVALID ? 10 : 11;
+    }
+  }
+
+  bool is_interrupt_ready() const {
+    return is_nmi || (is_irq && iff1 && !is_ei_delay);
+  }
+
+  // Run cached block at PC while it falls through, returning at until, HALT,
+  // cycle budget, a write into cached code, or an interrupt to accept
+  void run_block(uint16_t until, uint32_t start, uint32_t max_cycles) {
+    const Block& block = find_block(pc);
+    const MicroOp* op = block.ops;
+    const MicroOp* const end = op + block.n_ops;
+    is_flushed_ = false;
+    for (;;) {
+      const uint16_t next = pc + op->size;
+      is_ei_delay = false;
+      tick(execute_uop(*op, next));
+      // NOTE repeating ops like LDIR leave PC in place and restart the block
+      if (pc != next || ++op == end || pc == until || is_flushed_ || is_halted) return;
+      if (cycles - start >= max_cycles || is_interrupt_ready()) return;
+    }
+  }
+
+  // Execute opcode, with (HL)/H/L replaced by (IX/IY+d)/IXH/IXL when prefixed
+  uint8_t execute(uint8_t code, uint8_t prefix) {
+    const uint8_t y = (code & 070) >> 3;
+    const uint8_t z = code & 07;
+    const uint8_t disp_t = prefix != 0 ? 8 : 0;
+    switch (code >> 6) {
+    case 0:
+      return execute_lo(code, prefix);
+    case 1: // LD r,r
+      if (code == 0x76) { // HALT
+        is_halted = true;
+        return 4;
+      } else if (y == REG_M) {
+        // H/L are never IXH/IXL alongside (IX+d)
+        write(mem_addr(prefix), get_reg(z, 0));
+        return 7 + disp_t;
+      } else if (z == REG_M) {
+        set_reg(y, 0, read(mem_addr(prefix)));
+        return 7 + disp_t;
+      }
+      set_reg(y, prefix, get_reg(z, prefix));
+      return 4;
+    case 2: // ALU A,r
+      if (z == REG_M) {
+        alu(y, read(mem_addr(prefix)));
+        return 7 + disp_t;
+      }
+      alu(y, get_reg(z, prefix));
+      return 4;
+    default:
+      return execute_hi(code, prefix);
+    }
+  }
+};
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,106 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Instruction-level pattern search
+// Opcodes that can't decode to the pattern's mnemonic are stepped over by
+// InstructionRange without decoding; only candidates are fully decoded
+
+#pragma once
+
+#include "uMon/z80/dasm.hpp"
+#include "uMon/format.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Return true if operand matches pattern, which may contain wildcards
+inline bool match_operand(const Operand& pattern, const Operand& op) {
+  const uint8_t pat_token = pattern.token & TOK_MASK;
+  const uint8_t op_token = op.token & TOK_MASK;
+  const bool pat_indirect = (pattern.token & TOK_INDIRECT) != 0;
+  const bool op_indirect = (op.token & TOK_INDIRECT) != 0;
+  if (pat_token == TOK_WILDCARD) {
+    // (*) matches any indirect operand and (IX/IY+*) any displacement
+    if (pat_indirect) {
+      return op_indirect && (pattern.value == TOK_UNDEFINED || pattern.value == op_token);
+    }
+    // * matches any operand that is present
+    return op.token != TOK_INVALID;
+  }
+  // Ignore print formatting flags
+  return pat_token == op_token && pat_indirect == op_indirect && pattern.value == op.value;
+}
+
+// Return true if instruction matches pattern with the same number of operands
+inline bool match_instruction(const Instruction& pattern, const Instruction& inst) {
+  if (pattern.mnemonic != inst.mnemonic) return false;
+  for (uint8_t i = 0; i < MAX_OPERANDS; ++i) {
+    const Operand& pat_op = pattern.operands[i];
+    const Operand& op = inst.operands[i];
+    if (pat_op.token == TOK_INVALID) {
+      if (op.token != TOK_INVALID) return false;
+    } else if (!match_operand(pat_op, op)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Memory stand-in holding a lone opcode followed by zeroes
+template <typename API>
+struct OpcodeProbe : API {
+  static uint8_t code;
+  static uint8_t read_byte(uint16_t addr) { return addr == 0 ? code : 0; }
+};
+
+template <typename API>
+uint8_t OpcodeProbe<API>::code;
+
+// Bitmap of leading opcode bytes that can decode to mnemonic
+// Prefix bytes are always candidates since the mnemonic depends on what follows
+template <typename API>
+void find_candidates(uint8_t mnemonic, uint8_t (&bits)[32]) {
+  using Probe = OpcodeProbe<API>;
+  for (uint16_t code = 0; code < 256; ++code) {
+    bool is_candidate = true;
+    if (code != PREFIX_IX && code != PREFIX_IY && code != PREFIX_ED && code != PREFIX_CB) {
+      Instruction inst;
+      Probe::code = code;
+      dasm_instruction<Probe>(inst, 0);
+      is_candidate = inst.mnemonic == mnemonic;
+    }
+    if (is_candidate) {
+      bits[code / 8] |= 1 << (code % 8);
+    } else {
+      bits[code / 8] &= ~(1 << (code % 8));
+    }
+  }
+}
+
+// Print instructions matching pattern from addr to end, inclusive
+// Returns address following the last instruction searched
+template <typename API, uint8_t MAX_ROWS = 24>
+uint16_t find_range(uint16_t addr, uint16_t end, const Instruction& pattern) {
+  uint8_t candidates[32];
+  find_candidates<API>(pattern.mnemonic, candidates);
+  InstructionRange<API> range(addr, end);
+  auto it = range.begin();
+  for (uint8_t rows = 0; rows < MAX_ROWS && it != range.end(); ++it) {
+    // Only decode instructions that might match
+    const uint8_t code = API::read_byte(it.addr());
+    if ((candidates[code / 8] & (1 << (code % 8))) != 0 && match_instruction(pattern, *it)) {
+      API::print_char(' ');
+      format_hex16(API::print_char, it.addr());
+      API::print_string("  ");
+      print_instruction<API>(*it);
+      API::newline();
+      ++rows;
+    }
+  }
+  return it.addr();
+}
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,182 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Port devices for the emulator
+// An API forwards read_port/write_port/tick_devices to port_read/port_write/
+// port_tick with its devices; each device decodes SIZE ports from BASE in
+// the low byte of the port address, as most Z80 boards do
+
+#pragma once
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+inline uint8_t port_read(uint16_t) { return 0xFF; }
+
+// Read from the first device decoding port
+template <typename Device, typename... Rest>
+uint8_t port_read(uint16_t port, Device& device, Rest&... rest) {
+  const uint8_t offset = uint8_t(port) - Device::BASE;
+  return offset < Device::SIZE ? device.read(offset) : port_read(port, rest...);
+}
+
+inline void port_write(uint16_t, uint8_t) {}
+
+// Write to the first device decoding port
+template <typename Device, typename... Rest>
+void port_write(uint16_t port, uint8_t data, Device& device, Rest&... rest) {
+  const uint8_t offset = uint8_t(port) - Device::BASE;
+  if (offset < Device::SIZE) {
+    device.write(offset, data);
+  } else {
+    port_write(port, data, rest...);
+  }
+}
+
+inline bool port_tick(uint8_t, uint8_t&) { return false; }
+
+// Advance all devices; the first to request an interrupt puts data on the bus
+template <typename Device, typename... Rest>
+bool port_tick(uint8_t cycles, uint8_t& data, Device& device, Rest&... rest) {
+  uint8_t rest_data = 0xFF;
+  const bool is_rest_irq = port_tick(cycles, rest_data, rest...);
+  if (device.tick(cycles, data)) return true;
+  data = rest_data;
+  return is_rest_irq;
+}
+
+// Ring buffer of N bytes, N a power of 2
+template <uint8_t N>
+class Fifo {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+  uint8_t buf_[N];
+  uint8_t head_ = 0;
+  uint8_t tail_ = 0;
+
+public:
+  uint8_t size() const { return uint8_t(tail_ - head_); }
+  bool is_empty() const { return head_ == tail_; }
+  bool is_full() const { return size() == N; }
+  void clear() { head_ = tail_ = 0; }
+
+  bool push(uint8_t data) {
+    if (is_full()) return false;
+    buf_[tail_++ % N] = data;
+    return true;
+  }
+
+  bool pop(uint8_t& data) {
+    if (is_empty()) return false;
+    data = buf_[head_++ % N];
+    return true;
+  }
+};
+
+// Bits of UART status port
+enum {
+  UART_RX_READY = 0x01, // byte waiting at data port
+  UART_TX_READY = 0x02, // room to write data port
+};
+
+// UART with receive and transmit FIFOs and no baud delay
+// BASE+0 is data and BASE+1 is status; bytes written with TX full are lost
+template <uint8_t BASE_, uint8_t FIFO_SIZE = 16>
+class UartFifo {
+  Fifo<FIFO_SIZE> rx_;
+  Fifo<FIFO_SIZE> tx_;
+
+public:
+  static constexpr const uint8_t BASE = BASE_;
+  static constexpr const uint8_t SIZE = 2;
+
+  // Host side: queue byte for the target to read
+  bool send(uint8_t data) { return rx_.push(data); }
+
+  // Host side: take byte the target wrote
+  bool receive(uint8_t& data) { return tx_.pop(data); }
+
+  uint8_t read(uint8_t offset) {
+    if (offset == 1) {
+      return (rx_.is_empty() ? 0 : UART_RX_READY) | (tx_.is_full() ? 0 : UART_TX_READY);
+    }
+    uint8_t data = 0xFF;
+    rx_.pop(data);
+    return data;
+  }
+
+  void write(uint8_t offset, uint8_t data) {
+    if (offset == 0) tx_.push(data);
+  }
+
+  bool tick(uint8_t, uint8_t&) { return false; }
+};
+
+// Bits of timer control port
+enum {
+  TIMER_ENABLE = 0x01,
+  TIMER_IRQ = 0x02, // interrupt on expiry
+  TIMER_EXPIRED = 0x80, // status; cleared when read
+};
+
+// Periodic timer counting T-states
+// BASE+0/1 set the period (low/high), BASE+2 writes control and reads status,
+// and BASE+3 sets the byte put on the bus with each interrupt
+template <uint8_t BASE_>
+class Timer {
+  uint16_t period_ = 0;
+  uint32_t count_ = 0;
+  uint8_t control_ = 0;
+  uint8_t vector_ = 0xFF;
+  bool is_expired_ = false;
+
+public:
+  static constexpr const uint8_t BASE = BASE_;
+  static constexpr const uint8_t SIZE = 4;
+
+  uint8_t read(uint8_t offset) {
+    switch (offset) {
+    case 0: return period_ & 0xFF;
+    case 1: return period_ >> 8;
+    case 2: {
+      const uint8_t status = control_ | (is_expired_ ? TIMER_EXPIRED : 0);
+      is_expired_ = false;
+      return status;
+    }
+    default: return vector_;
+    }
+  }
+
+  void write(uint8_t offset, uint8_t data) {
+    switch (offset) {
+    case 0: period_ = (period_ & 0xFF00) | data; break;
+    case 1: period_ = (period_ & 0x00FF) | data << 8; break;
+    case 2:
+      // Count restarts when enabled
+      if ((data & ~control_ & TIMER_ENABLE) != 0) count_ = period_;
+      control_ = data & (TIMER_ENABLE | TIMER_IRQ);
+      break;
+    default: vector_ = data; break;
+    }
+  }
+
+  bool tick(uint8_t cycles, uint8_t& data) {
+    if ((control_ & TIMER_ENABLE) == 0 || period_ == 0) return false;
+    if (count_ > cycles) {
+      count_ -= cycles;
+      return false;
+    }
+    // Reload, skipping periods shorter than the instruction
+    count_ += period_;
+    while (count_ <= cycles) count_ += period_;
+    count_ -= cycles;
+    is_expired_ = true;
+    if ((control_ & TIMER_IRQ) == 0) return false;
+    data = vector_;
+    return true;
+  }
+};
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,151 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Execution profile of code run by the emulator
+// Instruction counts and T-states accumulate per PC and are summed from each
+// label to the next for reports; T-states of accepted interrupts count
+// toward the instruction they interrupted, and T-states spent halted
+// (including the interrupt that wakes the CPU) are counted as idle
+
+#pragma once
+
+#include "uMon/z80/emu.hpp"
+#include "uMon/format.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Totals from a label to the next, or of one bucket
+struct ProfileGroup {
+  const char* name; // null for code before the first label
+  uint16_t start;
+  uint32_t count;
+  uint32_t cycles;
+};
+
+// Histogram of N_BUCKETS buckets of 2^SHIFT bytes each from START; PCs
+// outside are not recorded
+// The default is one bucket per PC over all 64K, 512K of counters, which
+// suits hosted builds; allocate it statically
+// Smaller targets can pass a narrower range or a coarser SHIFT, but then the
+// report is per bucket, not per label: a label can fall inside a bucket, so
+// each bucket run is its own group, named only by a label at its first byte
+template <typename API, uint16_t START = 0, uint32_t N_BUCKETS = 0x10000, uint8_t SHIFT = 0>
+class Profiler {
+  static_assert(START + (N_BUCKETS << SHIFT) <= 0x10000, "Profiler range past $FFFF");
+
+  uint32_t counts_[N_BUCKETS];
+  uint32_t cycles_[N_BUCKETS];
+  uint32_t idle_cycles_;
+
+  static uint32_t bucket(uint16_t pc) { return uint16_t(pc - START) >> SHIFT; }
+
+  void add_group(ProfileGroup* groups, uint8_t max, uint8_t& n, const ProfileGroup& group) const {
+    if (group.count == 0) return;
+    // Insertion sort, keeping address order between equal T-states
+    uint8_t i = n < max ? n++ : max;
+    for (; i > 0 && groups[i - 1].cycles < group.cycles; --i) {
+      if (i < max) groups[i] = groups[i - 1];
+    }
+    if (i < max) groups[i] = group;
+  }
+
+public:
+  Profiler() { clear(); }
+
+  void clear() {
+    for (uint32_t& count : counts_) count = 0;
+    for (uint32_t& cycles : cycles_) cycles = 0;
+    idle_cycles_ = 0;
+  }
+
+  void record(uint16_t pc, uint8_t cycles) {
+    const uint32_t i = bucket(pc);
+    if (i >= N_BUCKETS) return;
+    counts_[i] += 1;
+    cycles_[i] += cycles;
+  }
+
+  // Totals of the bucket holding pc
+  uint32_t count(uint16_t pc) const { return bucket(pc) < N_BUCKETS ? counts_[bucket(pc)] : 0; }
+  uint32_t cycles(uint16_t pc) const { return bucket(pc) < N_BUCKETS ? cycles_[bucket(pc)] : 0; }
+
+  // T-states spent halted
+  uint32_t idle_cycles() const { return idle_cycles_; }
+
+  // Same as cpu.run, recording each instruction stepped
+  template <typename Cpu>
+  uint8_t run(Cpu& cpu, uint16_t until, uint32_t max_cycles) {
+    const uint32_t start = cpu.cycles;
+    for (;;) {
+      const uint8_t status = cpu.run_status(until, start, max_cycles);
+      if (status != RUN_NONE) return status;
+      if (cpu.is_halted) {
+        idle_cycles_ += cpu.step();
+        continue;
+      }
+      const uint16_t pc = cpu.pc;
+      record(pc, cpu.step());
+    }
+  }
+
+  // Fill groups with totals from each label to the next, or of each bucket
+  // when buckets are coarser than one byte, most T-states first
+  // Returns number of groups filled, omitting those never run
+  uint8_t group(ProfileGroup* groups, uint8_t max) const {
+    auto& labels = API::get_labels();
+    uint8_t n = 0;
+    if (SHIFT > 0) {
+      for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+        ProfileGroup group = { nullptr, uint16_t(START + (i << SHIFT)), counts_[i], cycles_[i] };
+        if (!labels.get_name(group.start, group.name)) group.name = nullptr;
+        add_group(groups, max, n, group);
+      }
+      return n;
+    }
+    ProfileGroup group = { nullptr, 0, 0, 0 };
+    auto cursor = labels.seek(0);
+    const char* name;
+    uint16_t next;
+    bool has_next = labels.get_cursor(cursor, name, next);
+    for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+      // Start a group at each label up to this PC
+      const uint16_t addr = START + i;
+      while (has_next && next <= addr) {
+        add_group(groups, max, n, group);
+        group = { name, next, 0, 0 };
+        labels.next(cursor);
+        has_next = labels.get_cursor(cursor, name, next);
+      }
+      group.count += counts_[i];
+      group.cycles += cycles_[i];
+    }
+    add_group(groups, max, n, group);
+    return n;
+  }
+
+  // Print totals of each group, most T-states first
+  template <uint8_t MAX_ROWS = 24>
+  void report() const {
+    ProfileGroup groups[MAX_ROWS];
+    const uint8_t n = group(groups, MAX_ROWS);
+    for (uint8_t i = 0; i < n; ++i) {
+      if (groups[i].name != nullptr) {
+        API::print_string(groups[i].name);
+      } else {
+        API::print_char('$');
+        format_hex16(API::print_char, groups[i].start);
+      }
+      API::print_string(": $");
+      format_hex32(API::print_char, groups[i].count);
+      API::print_string(" $");
+      format_hex32(API::print_char, groups[i].cycles);
+      API::newline();
+    }
+  }
+};
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,82 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Relocating block move
+// After copying, code in the block is decoded at its new address and each
+// 16-bit immediate that pointed into the old block is shifted by the distance
+// moved; DW regions are patched as tables of pointers and other data regions
+// are copied untouched
+
+#pragma once
+
+#include "uMon/z80/dasm.hpp"
+#include "uMon.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Shift word at addr by delta if it points into [start, end]
+// Returns true if patched
+template <typename API>
+bool reloc_word(uint16_t addr, uint16_t start, uint16_t end, uint16_t delta) {
+  uint8_t buf[2];
+  API::read_bytes(addr, buf);
+  uint16_t value = buf[1] << 8 | buf[0];
+  if (uint16_t(value - start) > uint16_t(end - start)) return false;
+  value += delta;
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+  API::write_bytes(addr, buf, 2);
+  return true;
+}
+
+// Move [start, end] to dest, patching absolute addresses into the block
+// Regions are looked up at their old addresses
+// Returns number of addresses patched
+template <typename API>
+uint16_t reloc_range(uint16_t start, uint16_t end, uint16_t dest) {
+  impl_memmove<API>(start, end, dest);
+  const uint16_t delta = dest - start;
+  uint16_t count = 0;
+  uint16_t old = start;
+  for (;;) {
+    const uint16_t addr = old + delta;
+    const uint16_t left = end - old; // bytes remaining after this one
+    uint16_t size;
+    uint16_t region_end;
+    const uint8_t type = API::get_regions().get_type(old, region_end);
+    if (type == REGION_WORD) {
+      // Patch whole words only
+      size = 1;
+      if (left >= 1 && region_end != old) {
+        size = 2;
+        count += reloc_word<API>(addr, start, end, delta);
+      }
+    } else if (type != REGION_CODE) {
+      size = region_end - old + 1;
+      if (size == 0) break; // region spans the whole address space
+    } else {
+      Instruction inst;
+      size = dasm_instruction<API>(inst, addr);
+      // Relative branches move with the code
+      const bool is_rel = inst.mnemonic == MNE_JR || inst.mnemonic == MNE_DJNZ;
+      for (const Operand& op : inst.operands) {
+        if (is_rel || left < size - 1) break;
+        if ((op.token & TOK_MASK) != TOK_IMMEDIATE || (op.token & (TOK_BYTE | TOK_DIGIT)) != 0) continue;
+        // Immediate always ends the instruction
+        count += reloc_word<API>(addr + size - 2, start, end, delta);
+      }
+    }
+
+    // Do while end does not overlap with opcode
+    uint16_t prev = old;
+    old += size;
+    if (uint16_t(end - prev) < size) { break; }
+  }
+  return count;
+}
+
+} // namespace z80
+} // namespace uMon
@@ -0,0 +1,239 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Save and restore emulator state as a binary blob
+// Layout: magic "ZS", version, registers and interrupt state, cycle count,
+// first and last address of the memory range, then memory packed in runs
+// Multi-byte fields are little-endian; each run begins with a count byte,
+// 0-127 for 1-128 literal bytes or 128-255 for 1 byte repeated 3-130 times
+
+#pragma once
+
+#include "uMon/z80/emu.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+constexpr const uint8_t SNAPSHOT_VERSION = 1;
+constexpr const uint8_t SNAPSHOT_HEADER = 40; // bytes before packed memory
+constexpr const uint8_t SNAPSHOT_RUN = 128; // longest literal run
+constexpr const uint8_t SNAPSHOT_MIN_REPEAT = 3;
+
+// Largest blob for size bytes of memory
+constexpr uint32_t snapshot_max_size(uint32_t size) {
+  return SNAPSHOT_HEADER + size + (size + SNAPSHOT_RUN - 1) / SNAPSHOT_RUN;
+}
+
+// Bounded little-endian writer; sets is_full instead of overflowing
+struct SnapshotWriter {
+  uint8_t* ptr;
+  uint8_t* const end;
+  bool is_full;
+
+  void put(uint8_t data) {
+    if (ptr == end) {
+      is_full = true;
+    } else {
+      *ptr++ = data;
+    }
+  }
+
+  void put16(uint16_t data) { put(data & 0xFF); put(data >> 8); }
+  void put32(uint32_t data) { put16(data & 0xFFFF); put16(data >> 16); }
+};
+
+// Bounded little-endian reader; sets is_empty instead of overrunning
+struct SnapshotReader {
+  const uint8_t* ptr;
+  const uint8_t* const end;
+  bool is_empty;
+
+  uint8_t get() {
+    if (ptr == end) {
+      is_empty = true;
+      return 0;
+    }
+    return *ptr++;
+  }
+
+  uint16_t get16() { uint8_t lsb = get(); return get() << 8 | lsb; }
+  uint32_t get32() { uint16_t lsw = get16(); return uint32_t(get16()) << 16 | lsw; }
+};
+
+// Packs a stream of bytes into literal and repeat runs
+class SnapshotPacker {
+  SnapshotWriter& out_;
+  uint8_t lit_[SNAPSHOT_RUN];
+  uint8_t n_lit_ = 0;
+  uint8_t rep_data_ = 0;
+  uint8_t n_rep_ = 0;
+
+  void flush_lit() {
+    if (n_lit_ == 0) return;
+    out_.put(n_lit_ - 1);
+    for (uint8_t i = 0; i < n_lit_; ++i) out_.put(lit_[i]);
+    n_lit_ = 0;
+  }
+
+  void flush_rep() {
+    if (n_rep_ >= SNAPSHOT_MIN_REPEAT) {
+      flush_lit();
+      out_.put(0x80 | (n_rep_ - SNAPSHOT_MIN_REPEAT));
+      out_.put(rep_data_);
+    } else {
+      // Short repeats join the literal run
+      for (uint8_t i = 0; i < n_rep_; ++i) {
+        lit_[n_lit_++] = rep_data_;
+        if (n_lit_ == SNAPSHOT_RUN) flush_lit();
+      }
+    }
+    n_rep_ = 0;
+  }
+
+public:
+  SnapshotPacker(SnapshotWriter& out): out_{out} {}
+
+  void put(uint8_t data) {
+    if (n_rep_ > 0 && data == rep_data_ && n_rep_ < SNAPSHOT_RUN + SNAPSHOT_MIN_REPEAT - 1) {
+      ++n_rep_;
+    } else {
+      flush_rep();
+      rep_data_ = data;
+      n_rep_ = 1;
+    }
+  }
+
+  void finish() {
+    flush_rep();
+    flush_lit();
+  }
+};
+
+// Pack memory from start to end, inclusive, reading a block at a time while
+// whole blocks fit and the tail a byte at a time; nothing past end is read
+template <typename API, uint8_t BLOCK_SIZE = 32>
+void save_memory(SnapshotWriter& out, uint16_t start, uint16_t end) {
+  SnapshotPacker packer(out);
+  uint8_t buf[BLOCK_SIZE];
+  uint32_t left = uint32_t(uint16_t(end - start)) + 1;
+  uint16_t addr = start;
+  for (; left >= BLOCK_SIZE; left -= BLOCK_SIZE, addr += BLOCK_SIZE) {
+    API::read_bytes(addr, buf);
+    for (uint8_t data : buf) packer.put(data);
+  }
+  for (; left > 0; --left, ++addr) {
+    packer.put(API::read_byte(addr));
+  }
+  packer.finish();
+}
+
+// Unpack runs into memory from start to end, inclusive
+// Returns false if runs do not exactly fill the range
+template <typename API>
+bool load_memory(SnapshotReader& in, uint16_t start, uint16_t end) {
+  uint8_t buf[SNAPSHOT_RUN + SNAPSHOT_MIN_REPEAT - 1];
+  uint32_t left = uint32_t(uint16_t(end - start)) + 1;
+  uint16_t addr = start;
+  while (left > 0) {
+    const uint8_t count = in.get();
+    uint8_t size;
+    if (count & 0x80) {
+      size = (count & 0x7F) + SNAPSHOT_MIN_REPEAT;
+      const uint8_t data = in.get();
+      for (uint8_t i = 0; i < size; ++i) buf[i] = data;
+    } else {
+      size = count + 1;
+      for (uint8_t i = 0; i < size; ++i) buf[i] = in.get();
+    }
+    if (in.is_empty || size > left) return false;
+    API::write_bytes(addr, buf, size);
+    addr += size;
+    left -= size;
+  }
+  return true;
+}
+
+// Save CPU state and memory from start to end, inclusive, into blob
+// Returns size of blob, or 0 if it would not fit in max_size
+template <typename API, uint8_t N_BLOCKS>
+uint32_t save_snapshot(const Cpu<API, N_BLOCKS>& cpu, uint16_t start, uint16_t end,
+    uint8_t* blob, uint32_t max_size) {
+  SnapshotWriter out = { blob, blob + max_size, false };
+  out.put('Z');
+  out.put('S');
+  out.put(SNAPSHOT_VERSION);
+  out.put(cpu.a);
+  out.put(cpu.f);
+  out.put(cpu.b);
+  out.put(cpu.c);
+  out.put(cpu.d);
+  out.put(cpu.e);
+  out.put(cpu.h);
+  out.put(cpu.l);
+  out.put16(cpu.ix);
+  out.put16(cpu.iy);
+  out.put16(cpu.sp);
+  out.put16(cpu.pc);
+  out.put16(cpu.af2);
+  out.put16(cpu.bc2);
+  out.put16(cpu.de2);
+  out.put16(cpu.hl2);
+  out.put(cpu.i);
+  out.put(cpu.r);
+  out.put(cpu.im);
+  out.put(cpu.iff1 | cpu.iff2 << 1 | cpu.is_halted << 2 | cpu.is_ei_delay << 3
+    | cpu.is_nmi << 4 | cpu.is_irq << 5);
+  out.put(cpu.irq_data);
+  out.put32(cpu.cycles);
+  out.put16(start);
+  out.put16(end);
+  save_memory<API>(out, start, end);
+  return out.is_full ? 0 : out.ptr - blob;
+}
+
+// Restore CPU state and memory saved by save_snapshot
+// Returns false if blob is not a valid snapshot; state may be partly restored
+template <typename API, uint8_t N_BLOCKS>
+bool load_snapshot(Cpu<API, N_BLOCKS>& cpu, const uint8_t* blob, uint32_t size) {
+  SnapshotReader in = { blob, blob + size, false };
+  if (in.get() != 'Z' || in.get() != 'S' || in.get() != SNAPSHOT_VERSION) return false;
+  cpu.a = in.get();
+  cpu.f = in.get();
+  cpu.b = in.get();
+  cpu.c = in.get();
+  cpu.d = in.get();
+  cpu.e = in.get();
+  cpu.h = in.get();
+  cpu.l = in.get();
+  cpu.ix = in.get16();
+  cpu.iy = in.get16();
+  cpu.sp = in.get16();
+  cpu.pc = in.get16();
+  cpu.af2 = in.get16();
+  cpu.bc2 = in.get16();
+  cpu.de2 = in.get16();
+  cpu.hl2 = in.get16();
+  cpu.i = in.get();
+  cpu.r = in.get();
+  cpu.im = in.get();
+  const uint8_t bits = in.get();
+  cpu.iff1 = bits & 1;
+  cpu.iff2 = bits & 2;
+  cpu.is_halted = bits & 4;
+  cpu.is_ei_delay = bits & 8;
+  cpu.is_nmi = bits & 16;
+  cpu.is_irq = bits & 32;
+  cpu.irq_data = in.get();
+  cpu.cycles = in.get32();
+  const uint16_t start = in.get16();
+  const uint16_t end = in.get16();
+  if (in.is_empty) return false;
+  const bool is_ok = load_memory<API>(in, start, end);
+  cpu.invalidate(start, end);
+  return is_ok;
+}
+
+} // namespace z80
+} // namespace uMon
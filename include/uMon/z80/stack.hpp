@@ -0,0 +1,217 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Static stack-depth analysis over the call graph
+// Every path reachable from an entry point is traced by following JP/JR/DJNZ
+// branches and descending into CALL/RST targets, while SP adjustments made by
+// PUSH/POP/CALL/RET/INC SP/DEC SP are tallied along the way
+
+#pragma once
+
+#include "uMon/z80/dasm.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Conditions that make the computed depth a lower bound
+enum {
+  STACK_RECURSION = 0x01, // CALL/RST target already on the call chain
+  STACK_INDIRECT = 0x02, // JP (HL/IX/IY) or RET to pushed address
+  STACK_SP_LOAD = 0x04, // LD SP loaded from register or memory
+  STACK_UNBALANCED = 0x08, // paths join with different depths
+  STACK_LIMIT = 0x10, // ran out of trace, call, or byte budget
+};
+
+struct StackResult {
+  uint16_t depth; // bytes pushed below SP at entry, including callees
+  uint8_t flags; // STACK_* conditions found
+  uint16_t flag_addr; // address of first flagged instruction
+};
+
+// Traces are kept in one shared pool; each routine on the call chain owns the
+// traces appended after those of its caller, so nesting costs no extra RAM
+template <typename API, uint8_t MAX_TRACES = 48, uint8_t MAX_CALLS = 12, uint8_t MAX_MEMO = 8>
+class StackAnalyzer {
+  struct Trace {
+    uint16_t addr;
+    int16_t depth;
+  };
+
+  Trace traces_[MAX_TRACES];
+  uint8_t n_traces_ = 0;
+  uint16_t calls_[MAX_CALLS];
+  uint8_t n_calls_ = 0;
+  struct Memo {
+    uint16_t addr;
+    StackResult result;
+  } memo_[MAX_MEMO];
+  uint8_t n_memo_ = 0;
+
+  static void flag(StackResult& result, uint8_t flags, uint16_t addr) {
+    if (result.flags == 0) {
+      result.flag_addr = addr;
+    }
+    result.flags |= flags;
+  }
+
+  // Merge flags and depth of callee into caller
+  static void merge(StackResult& result, const StackResult& callee, int16_t depth) {
+    if (callee.flags != 0) {
+      flag(result, callee.flags, callee.flag_addr);
+    }
+    int16_t total = depth + callee.depth;
+    if (total > int16_t(result.depth)) {
+      result.depth = total;
+    }
+  }
+
+  // Find trace in current routine starting at addr, or MAX_TRACES if none
+  uint8_t find_trace(uint8_t base, uint16_t addr) const {
+    for (uint8_t i = base; i < n_traces_; ++i) {
+      if (traces_[i].addr == addr) return i;
+    }
+    return MAX_TRACES;
+  }
+
+  // Queue branch target for tracing with current depth
+  void add_trace(StackResult& result, uint8_t base, uint16_t addr, int16_t depth, uint16_t from) {
+    uint8_t i = find_trace(base, addr);
+    if (i < MAX_TRACES) {
+      if (traces_[i].depth != depth) {
+        flag(result, STACK_UNBALANCED, from);
+      }
+    } else if (n_traces_ < MAX_TRACES) {
+      traces_[n_traces_++] = { addr, depth };
+    } else {
+      flag(result, STACK_LIMIT, from);
+    }
+  }
+
+  // Follow straight-line code from trace until path ends or joins another
+  void trace_path(StackResult& result, uint8_t base, uint8_t index) {
+    uint16_t addr = traces_[index].addr;
+    int16_t depth = traces_[index].depth;
+    uint16_t budget = 0;
+    for (;;) {
+      Instruction inst;
+      uint8_t size = dasm_instruction<API>(inst, addr);
+      const Operand& op1 = inst.operands[0];
+      const Operand& op2 = inst.operands[1];
+      const bool is_cond = op2.token != TOK_INVALID;
+      const uint16_t next = addr + size;
+      switch (inst.mnemonic) {
+      case MNE_PUSH:
+        depth += 2;
+        break;
+      case MNE_POP:
+        depth -= 2;
+        break;
+      case MNE_INC:
+        if (op1.token == TOK_SP) depth -= 1;
+        break;
+      case MNE_DEC:
+        if (op1.token == TOK_SP) depth += 1;
+        break;
+      case MNE_LD:
+        if (op1.token == TOK_SP) {
+          // LD SP,nn starts a fresh stack; anything else is unknown
+          if (op2.token == TOK_IMMEDIATE) {
+            depth = 0;
+          } else {
+            flag(result, STACK_SP_LOAD, addr);
+          }
+        }
+        break;
+      case MNE_CALL:
+        merge(result, analyze(is_cond ? op2.value : op1.value), depth + 2);
+        break;
+      case MNE_RST:
+        merge(result, analyze(op1.value), depth + 2);
+        break;
+      case MNE_RET:
+      case MNE_RETI:
+      case MNE_RETN:
+        if (depth != 0) {
+          // Returning through an address pushed by this routine
+          flag(result, STACK_INDIRECT, addr);
+        }
+        if (inst.mnemonic == MNE_RET && op1.token != TOK_INVALID) break;
+        return;
+      case MNE_JP:
+        if ((op1.token & TOK_INDIRECT) != 0) {
+          flag(result, STACK_INDIRECT, addr);
+          return;
+        }
+        // fall through
+      case MNE_JR:
+      case MNE_DJNZ:
+        add_trace(result, base, is_cond ? op2.value : op1.value, depth, addr);
+        if (!is_cond && inst.mnemonic != MNE_DJNZ) return;
+        break;
+      }
+      if (depth > int16_t(result.depth)) {
+        result.depth = depth;
+      }
+      // Stop if path runs into code already queued for tracing
+      if (find_trace(base, next) < MAX_TRACES) {
+        add_trace(result, base, next, depth, addr);
+        return;
+      }
+      // Give up on paths that run through the entire address space
+      uint16_t prev = budget;
+      budget += size;
+      if (budget < prev) {
+        flag(result, STACK_LIMIT, addr);
+        return;
+      }
+      addr = next;
+    }
+  }
+
+public:
+  // Find maximum stack depth of routine at entry and everything it calls
+  StackResult analyze(uint16_t entry) {
+    StackResult result = { 0, 0, 0 };
+
+    // Flag recursion if routine is already on the call chain
+    for (uint8_t i = 0; i < n_calls_; ++i) {
+      if (calls_[i] == entry) {
+        flag(result, STACK_RECURSION, entry);
+        return result;
+      }
+    }
+
+    // Reuse result of routines already analyzed
+    for (uint8_t i = 0; i < n_memo_; ++i) {
+      if (memo_[i].addr == entry) {
+        return memo_[i].result;
+      }
+    }
+
+    if (n_calls_ == MAX_CALLS || n_traces_ == MAX_TRACES) {
+      flag(result, STACK_LIMIT, entry);
+      return result;
+    }
+
+    // Trace paths in queue order; branches append new traces as they go
+    calls_[n_calls_++] = entry;
+    const uint8_t base = n_traces_;
+    traces_[n_traces_++] = { entry, 0 };
+    for (uint8_t i = base; i < n_traces_; ++i) {
+      trace_path(result, base, i);
+    }
+    n_traces_ = base;
+    --n_calls_;
+
+    // Recursion flag depends on the call chain, so don't reuse those results
+    if ((result.flags & STACK_RECURSION) == 0) {
+      memo_[n_memo_ < MAX_MEMO ? n_memo_++ : entry % MAX_MEMO] = { entry, result };
+    }
+    return result;
+  }
+};
+
+} // namespace z80
+} // namespace uMon
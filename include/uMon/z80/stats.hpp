@@ -0,0 +1,93 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Opcode usage statistics
+// Counts are kept per mnemonic rather than per opcode so that the tally fits
+// in a few hundred bytes of stack on small targets
+
+#pragma once
+
+#include "uMon/z80/dasm.hpp"
+
+#include <stdint.h>
+
+namespace uMon {
+namespace z80 {
+
+// Prefix bytes tallied separately from mnemonics
+enum {
+  STATS_IX,
+  STATS_IY,
+  STATS_ED,
+  STATS_CB, // includes DDCB and FDCB
+  STATS_PREFIXES,
+};
+
+// Instruction and byte counts per mnemonic, with MNE_INVALID for bad opcodes
+// Counts saturate at $FFFF, which a full 64K scan can only reach when one
+// mnemonic fills nearly all of memory; totals are exact
+template <typename API>
+class OpcodeStats {
+  uint16_t counts_[MNE_INVALID + 1] = {};
+  uint16_t bytes_[MNE_INVALID + 1] = {};
+  uint16_t prefixes_[STATS_PREFIXES] = {};
+  uint32_t total_count_ = 0;
+  uint32_t total_bytes_ = 0;
+
+  static void tally(uint16_t& count, uint8_t n) {
+    count = count > 0xFFFF - n ? 0xFFFF : count + n;
+  }
+
+public:
+  // Tally instructions from start to end, inclusive
+  void add(uint16_t start, uint16_t end) {
+    InstructionRange<API> range(start, end);
+    for (auto it = range.begin(); it != range.end(); ++it) {
+      const uint8_t code = API::read_byte(it.addr());
+      switch (code) {
+      case PREFIX_IX:
+      case PREFIX_IY:
+        tally(prefixes_[code == PREFIX_IX ? STATS_IX : STATS_IY], 1);
+        if (API::read_byte(it.addr() + 1) == PREFIX_CB) {
+          tally(prefixes_[STATS_CB], 1);
+        }
+        break;
+      case PREFIX_ED:
+      case PREFIX_CB:
+        tally(prefixes_[code == PREFIX_ED ? STATS_ED : STATS_CB], 1);
+        break;
+      }
+      const uint8_t mnemonic = it->mnemonic;
+      const uint8_t size = it.size();
+      tally(counts_[mnemonic], 1);
+      tally(bytes_[mnemonic], size);
+      total_count_ += 1;
+      total_bytes_ += size;
+    }
+  }
+
+  uint16_t count(uint8_t mnemonic) const { return counts_[mnemonic]; }
+  uint16_t bytes(uint8_t mnemonic) const { return bytes_[mnemonic]; }
+  uint16_t prefix(uint8_t index) const { return prefixes_[index]; }
+  uint32_t total_count() const { return total_count_; }
+  uint32_t total_bytes() const { return total_bytes_; }
+
+  // Fill order with mnemonics seen, most frequent first
+  // Returns number of mnemonics in order
+  uint8_t sort(uint8_t (&order)[MNE_INVALID + 1]) const {
+    uint8_t n = 0;
+    for (uint8_t mnemonic = 0; mnemonic <= MNE_INVALID; ++mnemonic) {
+      if (counts_[mnemonic] == 0) continue;
+      // Insertion sort, keeping alphabetical order between equal counts
+      uint8_t i = n++;
+      for (; i > 0 && counts_[order[i - 1]] < counts_[mnemonic]; --i) {
+        order[i] = order[i - 1];
+      }
+      order[i] = mnemonic;
+    }
+    return n;
+  }
+};
+
+} // namespace z80
+} // namespace uMon
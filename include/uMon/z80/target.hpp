@@ -0,0 +1,129 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+// Target-assisted fill and move
+// Rather than a bus cycle per byte from the host, a stub ending in LDIR or
+// LDDR and HALT is uploaded to SCRATCH and run by the target CPU through
+// API::run_cpu; the bytes under the stub are saved first and put back after
+// Falls back to impl_memset/impl_memmove when there is no CPU to run or when
+// the range touches the scratch area
+
+#pragma once
+
+#include "uMon/z80/asm.hpp"
+#include "uMon.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace uMon {
+namespace z80 {
+
+// LD HL,nn; LD DE,nn; LD BC,nn; LD (HL),n; LDIR; HALT
+constexpr const uint8_t TARGET_STUB_SIZE = 14;
+
+// Collects the stub so it is uploaded with one API::write_bytes
+template <typename API>
+struct StubAPI : API {
+  static uint8_t buf[TARGET_STUB_SIZE];
+  static uint16_t base;
+  static uint8_t fill;
+
+  static void write_bytes(uint16_t addr, const uint8_t* data, uint8_t size) {
+    memcpy(buf + uint8_t(addr - base), data, size);
+    fill += size;
+  }
+};
+
+template <typename API> uint8_t StubAPI<API>::buf[TARGET_STUB_SIZE];
+template <typename API> uint16_t StubAPI<API>::base;
+template <typename API> uint8_t StubAPI<API>::fill;
+
+// True if [start, end] and [addr, addr+size) share any address
+inline bool is_overlap(uint16_t start, uint16_t end, uint16_t addr, uint8_t size) {
+  return uint16_t(addr - start) <= uint16_t(end - start)
+    || uint16_t(start - addr) < size;
+}
+
+// Run LDIR (or LDDR if is_reverse) with HL=src, DE=dest, BC=count at SCRATCH
+// If is_fill, pattern is stored to (HL) first
+// Returns false if API::run_cpu could not run the stub
+template <typename API, uint16_t SCRATCH>
+bool target_ldir(uint16_t src, uint16_t dest, uint16_t count, bool is_reverse,
+    bool is_fill = false, uint8_t pattern = 0) {
+  using Stub = StubAPI<API>;
+  Stub::base = SCRATCH;
+  Stub::fill = 0;
+  uint16_t addr = SCRATCH;
+  Instruction ld_hl(MNE_LD, TOK_HL, {TOK_IMMEDIATE, src});
+  addr += asm_instruction<Stub>(ld_hl, addr);
+  Instruction ld_de(MNE_LD, TOK_DE, {TOK_IMMEDIATE, dest});
+  addr += asm_instruction<Stub>(ld_de, addr);
+  Instruction ld_bc(MNE_LD, TOK_BC, {TOK_IMMEDIATE, count});
+  addr += asm_instruction<Stub>(ld_bc, addr);
+  if (is_fill) {
+    Instruction ld_n(MNE_LD, TOK_HL_IND, {TOK_IMMEDIATE, pattern});
+    addr += asm_instruction<Stub>(ld_n, addr);
+  }
+  Instruction ldir(is_reverse ? MNE_LDDR : MNE_LDIR);
+  addr += asm_instruction<Stub>(ldir, addr);
+  Instruction halt(MNE_HALT);
+  addr += asm_instruction<Stub>(halt, addr);
+
+  uint8_t saved[TARGET_STUB_SIZE];
+  API::read_bytes(SCRATCH, saved);
+  API::write_bytes(SCRATCH, Stub::buf, Stub::fill);
+  const bool is_run = API::run_cpu(SCRATCH);
+  API::write_bytes(SCRATCH, saved, Stub::fill);
+  return is_run;
+}
+
+// Same as impl_memset, run by the target CPU where possible
+template <typename API, uint16_t SCRATCH>
+void target_memset(uint16_t start, uint16_t end, uint8_t pattern) {
+  // Pattern is stored at start and LDIR drags it forward one byte at a time
+  if (start == end || is_overlap(start, end, SCRATCH, TARGET_STUB_SIZE)
+      || !target_ldir<API, SCRATCH>(start, start + 1, end - start, false, true, pattern)) {
+    impl_memset<API>(start, end, pattern);
+  }
+}
+
+// Same as impl_memmove, run by the target CPU where possible
+template <typename API, uint16_t SCRATCH>
+void target_memmove(uint16_t start, uint16_t end, uint16_t dest) {
+  const uint16_t delta = end - start;
+  const uint16_t dest_end = dest + delta;
+  if (is_overlap(start, end, SCRATCH, TARGET_STUB_SIZE)
+      || is_overlap(dest, dest_end, SCRATCH, TARGET_STUB_SIZE)) {
+    impl_memmove<API>(start, end, dest);
+    return;
+  }
+  const bool is_reverse = is_memmove_reverse(start, end, dest);
+  const bool is_run = is_reverse
+    ? target_ldir<API, SCRATCH>(end, dest_end, delta + 1, true)
+    : target_ldir<API, SCRATCH>(start, dest, delta + 1, false);
+  if (!is_run) {
+    impl_memmove<API>(start, end, dest);
+  }
+}
+
+// Same as cmd_fill, with LDIR run by the target CPU from SCRATCH
+template <typename API, uint16_t SCRATCH>
+void cmd_target_fill(uCLI::Args args) {
+  uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
+  uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+  uMON_EXPECT_UINT(API, uint8_t, pattern, args, return);
+  target_memset<API, SCRATCH>(start, start + size - 1, pattern);
+}
+
+// Same as cmd_move, with LDIR/LDDR run by the target CPU from SCRATCH
+template <typename API, uint16_t SCRATCH>
+void cmd_target_move(uCLI::Args args) {
+  uMON_EXPECT_ADDR(API, uint16_t, start, args, return);
+  uMON_EXPECT_UINT(API, uint16_t, size, args, return);
+  uMON_EXPECT_ADDR(API, uint16_t, dest, args, return);
+  target_memmove<API, SCRATCH>(start, start + size - 1, dest);
+}
+
+} // namespace z80
+} // namespace uMon
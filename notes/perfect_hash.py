@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+# Find MULT/SEED for the perfect hashes in include/uMon/z80/common.hpp
+# Run after editing mnemonics.def or tokens.def trips the static_assert
+
+import os
+import re
+
+DEF_DIR = os.path.join(os.path.dirname(__file__), '..', 'include', 'uMon', 'z80')
+
+def read_names(file):
+    with open(os.path.join(DEF_DIR, file)) as f:
+        return re.findall(r'^ITEM\((\w+)\)', f.read(), re.M)
+
+# Must match hash_step in include/uMon/hash.hpp
+def hash_str(name, mult, seed):
+    h = seed
+    for c in name:
+        h = (h * mult + (ord(c) | 0x20)) & 0xFF
+    return h
+
+# Smallest power of 2 table, then first MULT/SEED, with no collisions
+def search(names):
+    for bits in range(1, 9):
+        mask = (1 << bits) - 1
+        if mask + 1 < len(names):
+            continue
+        for mult in range(1, 256):
+            for seed in range(256):
+                slots = {hash_str(n, mult, seed) & mask for n in names}
+                if len(slots) == len(names):
+                    return mult, seed, mask
+    return None
+
+for name, names in (('MneHash', read_names('mnemonics.def')),
+                    ('TokHash', ['?'] + read_names('tokens.def'))):
+    result = search(names)
+    if result is None:
+        print(f'{name}: none found')
+    else:
+        print(f'{name}: MULT = {result[0]}, SEED = {result[1]}, MASK = 0x{result[2]:02X}')
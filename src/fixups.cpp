@@ -0,0 +1,78 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+#include "uMon/fixups.hpp"
+
+#include <string.h>
+
+// Each entry is [size][addr lo][addr hi][kind][name...\0]
+
+namespace uMon {
+
+void Fixups::remove(uint8_t offset) {
+  // Move following entries forward to fill vacancy
+  uint8_t size = *(buffer_ + offset);
+  used_ -= size;
+  memmove(buffer_ + offset, buffer_ + offset + size, used_ - offset);
+  --entries_;
+}
+
+bool Fixups::get_index(uint8_t index, const char*& name, uint16_t& addr, uint8_t& kind) const {
+  if (index >= entries_) {
+    return false;
+  }
+
+  // Where in the buffer is index?
+  uint8_t offset = 0;
+  for (; index > 0; --index) {
+    offset += *(buffer_ + offset);
+  }
+
+  addr = *(uint16_t*)(buffer_ + offset + 1);
+  kind = *(buffer_ + offset + 3);
+  name = buffer_ + offset + 4;
+  return true;
+}
+
+bool Fixups::add(const char* name, uint16_t addr, uint8_t kind) {
+  // Abort if buffer is too full
+  size_t size = strlen(name) + 5;
+  if (size > uint8_t(buf_size_ - used_)) {
+    return false;
+  }
+
+  // Append entry to end of buffer
+  char* entry = buffer_ + used_;
+  *entry = size;
+  *(uint16_t*)(entry + 1) = addr;
+  *(entry + 3) = kind;
+  strcpy(entry + 4, name);
+  used_ += size;
+  ++entries_;
+  return true;
+}
+
+bool Fixups::take(const char* name, uint16_t& addr, uint8_t& kind) {
+  for (uint8_t offset = 0; offset < used_; offset += *(buffer_ + offset)) {
+    if (strcmp(buffer_ + offset + 4, name) == 0) {
+      addr = *(uint16_t*)(buffer_ + offset + 1);
+      kind = *(buffer_ + offset + 3);
+      remove(offset);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Fixups::discard(uint16_t start, uint16_t end) {
+  for (uint8_t offset = 0; offset < used_; ) {
+    uint16_t addr = *(uint16_t*)(buffer_ + offset + 1);
+    if (uint16_t(addr - start) <= uint16_t(end - start)) {
+      remove(offset);
+    } else {
+      offset += *(buffer_ + offset);
+    }
+  }
+}
+
+} // namespace uMon
@@ -85,6 +85,31 @@ bool Labels::remove_range(uint8_t first, uint8_t last) {
   return true;
 }
 
+Labels::Cursor Labels::seek(uint16_t addr) const {
+  Cursor cursor = { 0, 0 };
+  while (cursor.index < entries_ && *(uint16_t*)(buffer_ + cursor.offset + 1) < addr) {
+    next(cursor);
+  }
+  return cursor;
+}
+
+void Labels::next(Cursor& cursor) const {
+  if (cursor.index < entries_) {
+    cursor.offset += *(buffer_ + cursor.offset);
+    ++cursor.index;
+  }
+}
+
+bool Labels::get_cursor(const Cursor& cursor, const char*& name, uint16_t& addr) const {
+  if (cursor.index >= entries_) {
+    return false;
+  }
+  char* entry = buffer_ + cursor.offset + sizeof(uint8_t);
+  addr = *(uint16_t*)entry;
+  name = entry + 2;
+  return true;
+}
+
 bool Labels::get_index(uint8_t index, const char*& name, uint16_t& addr) const {
   uint8_t size;
   char* entry = get(index, size);
@@ -111,15 +136,8 @@ bool Labels::get_addr(const char* name, uint16_t& addr) const {
 
 // Result<bool, const char*> or something would be nice...
 bool Labels::get_name(uint16_t addr, const char*& name) const {
-  for (uint8_t i = 0; i < entries(); ++i) {
-    uint8_t size;
-    char* entry = get(i, size);
-    if (*(uint16_t*)entry == addr) {
-      name = entry + 2;
-      return true;
-    }
-  }
-  return false;
+  uint16_t found;
+  return get_cursor(seek(addr), name, found) && found == addr;
 }
 
 bool Labels::remove_label(const char* name) {
@@ -136,7 +154,14 @@ bool Labels::remove_label(const char* name) {
 
 bool Labels::set_label(const char* name, uint16_t addr) {
   remove_label(name);
-  char* entry = insert(entries(), strlen(name) + 3);
+  // Insert after any entries with the same address
+  Cursor cursor = seek(addr);
+  const char* other;
+  uint16_t other_addr;
+  while (get_cursor(cursor, other, other_addr) && other_addr == addr) {
+    next(cursor);
+  }
+  char* entry = insert(cursor.index, strlen(name) + 3);
   if (entry == nullptr) {
     return false;
   }
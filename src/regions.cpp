@@ -0,0 +1,136 @@
+// https://github.com/trevor-makes/uMon.git
+// Copyright (c) 2022 Trevor Makes
+
+#include "uMon/regions.hpp"
+
+#include <string.h>
+
+namespace uMon {
+
+bool Regions::insert(uint8_t index, const Region& region) {
+  if (index > entries_ || entries_ == buf_size_) {
+    return false;
+  }
+
+  // Move following entries back to make room
+  memmove(buffer_ + index + 1, buffer_ + index, (entries_ - index) * sizeof(Region));
+  buffer_[index] = region;
+  ++entries_;
+  return true;
+}
+
+void Regions::remove(uint8_t index) {
+  // Move following entries forward to fill vacancy
+  --entries_;
+  memmove(buffer_ + index, buffer_ + index + 1, (entries_ - index) * sizeof(Region));
+}
+
+bool Regions::get_index(uint8_t index, uint16_t& start, uint16_t& end, uint8_t& type) const {
+  if (index >= entries_) {
+    return false;
+  }
+  start = buffer_[index].start;
+  end = buffer_[index].end;
+  type = buffer_[index].type;
+  return true;
+}
+
+uint8_t Regions::get_type(uint16_t addr, uint16_t& end) const {
+  // Binary search for last region starting at or before addr
+  uint8_t lo = 0;
+  uint8_t hi = entries_;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (buffer_[mid].start <= addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo > 0 && buffer_[lo - 1].end >= addr) {
+    end = buffer_[lo - 1].end;
+    return buffer_[lo - 1].type;
+  }
+  // Code extends up to the next region
+  end = lo < entries_ ? buffer_[lo].start - 1 : 0xFFFF;
+  return REGION_CODE;
+}
+
+bool Regions::mark(uint16_t start, uint16_t end, uint8_t type) {
+  // Split ranges that wrap around the address space, making sure both halves
+  // fit first so that a failure changes nothing
+  if (end < start) {
+    uint8_t needed = type != REGION_CODE ? 2 : 0;
+    for (uint8_t i = 0; i < entries_; ++i) {
+      // Only regions reaching between end and start survive
+      if (buffer_[i].end > end && buffer_[i].start < start) {
+        needed += 1;
+      }
+    }
+    if (needed > buf_size_) {
+      return false;
+    }
+    return mark(start, 0xFFFF, type) && mark(0, end, type);
+  }
+
+  // Count entries that survive trimming, and find where new entry goes
+  uint8_t needed = 0;
+  uint8_t index = 0;
+  for (uint8_t i = 0; i < entries_; ++i) {
+    const Region& r = buffer_[i];
+    if (r.start < start && r.end > end) {
+      // Marking inside an existing region of the same type changes nothing
+      if (r.type == type) return true;
+      needed += 2; // region will be split in two
+    } else if (r.end < start || r.start > end || r.start < start || r.end > end) {
+      needed += 1; // region is kept or trimmed
+    }
+    if (r.start < start) {
+      index = i + 1;
+    }
+  }
+  if (type != REGION_CODE) {
+    needed += 1;
+  }
+  if (needed > buf_size_) {
+    return false;
+  }
+
+  // Trim or remove regions overlapping [start, end]
+  for (uint8_t i = 0; i < entries_; ) {
+    Region& r = buffer_[i];
+    if (r.end < start || r.start > end) {
+      ++i;
+    } else if (r.start < start && r.end > end) {
+      Region tail = { uint16_t(end + 1), r.end, r.type };
+      r.end = start - 1;
+      insert(i + 1, tail);
+      break;
+    } else if (r.start < start) {
+      r.end = start - 1;
+      ++i;
+    } else if (r.end > end) {
+      r.start = end + 1;
+      ++i;
+    } else {
+      remove(i);
+    }
+  }
+  if (type == REGION_CODE) {
+    return true;
+  }
+
+  // Insert new region, merging with neighbors of the same type
+  if (index > 0 && buffer_[index - 1].type == type && buffer_[index - 1].end + 1 == start) {
+    --index;
+    start = buffer_[index].start;
+    remove(index);
+  }
+  if (index < entries_ && buffer_[index].type == type && end + 1 == buffer_[index].start) {
+    end = buffer_[index].end;
+    remove(index);
+  }
+  return insert(index, { start, end, type });
+}
+
+} // namespace uMon
@@ -1,18 +1,29 @@
 #include "uMon/z80.hpp"
+#include "uMon/z80/casm.hpp"
+#include "uMon/z80/debug.hpp"
+#include "uMon/z80/ports.hpp"
+#include "uMon/z80/profile.hpp"
+#include "uMon/z80/snapshot.hpp"
+#include "uMon/z80/target.hpp"
 #include "uMon/api.hpp"
+#include "uMon/sim.hpp"
 
 #include <unity.h>
+#include <ctype.h>
+#include <string.h>
 
 using namespace uMon::z80;
 
-constexpr const uint16_t DATA_SIZE = 8;
+constexpr const uint16_t DATA_SIZE = 256;
 uint8_t test_data[DATA_SIZE];
 uCLI::CursorOwner<16> test_io;
+const char* test_input = "";
 
 struct TestAPI : public uMon::Base<TestAPI> {
   static void print_char(char c) { test_io.try_insert(c); }
   static void print_string(const char* str) { test_io.try_insert(str); }
   static void newline() { test_io.try_insert('\n'); }
+  static char input_char() { return *test_input != '\0' ? *test_input++ : '\n'; }
 
   static uint8_t read_byte(uint16_t addr) { return test_data[addr % DATA_SIZE]; };
   static void write_byte(uint16_t addr, uint8_t data) { test_data[addr % DATA_SIZE] = data; }
@@ -21,6 +32,15 @@ struct TestAPI : public uMon::Base<TestAPI> {
   static void prompt_string(const char* str) { }
 };
 
+// Keeps all output for commands that print more than test_io holds
+uCLI::CursorOwner<128> test_log;
+
+struct LogAPI : public TestAPI {
+  static void print_char(char c) { test_log.try_insert(c); }
+  static void print_string(const char* str) { test_log.try_insert(str); }
+  static void newline() { test_log.try_insert('\n'); }
+};
+
 struct AsmTest {
   const char* str;
   uint8_t n_bytes;
@@ -76,6 +96,15 @@ void test_asm(const AsmTest& test) {
   test_io.clear();
   print_instruction<TestAPI>(inst_out);
   TEST_ASSERT_EQUAL_STRING_MESSAGE(test.str, test_io.contents(), test.str);
+
+  // Format instruction into buffer, and again truncated by one character
+  char buf[32];
+  const size_t len = strlen(test.str);
+  TEST_ASSERT_EQUAL_MESSAGE(len, format_instruction<TestAPI>(buf, sizeof(buf), inst_out), test.str);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(test.str, buf, test.str);
+  TEST_ASSERT_EQUAL_MESSAGE(len - 1, format_instruction<TestAPI>(buf, len, inst_out), test.str);
+  TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(test.str, buf, len - 1, test.str);
+  TEST_ASSERT_EQUAL_MESSAGE(0, format_instruction<TestAPI>(buf, 0, inst_out), test.str);
 }
 
 AsmTest misc_cases[] = {
@@ -166,6 +195,51 @@ void test_asm_misc(void) {
   }
 }
 
+// Every fixed.def entry encodes and decodes through the shared table
+void test_asm_fixed(void) {
+  for (uint8_t i = 0; i < N_FIXED; ++i) {
+    const Fixed& entry = FIXED[i];
+    Instruction inst = {entry.mnemonic, {entry.op1}, {entry.op2}};
+    const uint8_t size = entry.prefix == 0 ? 1 : 2;
+    TEST_ASSERT_EQUAL(size, asm_instruction<TestAPI>(inst, 0));
+    TEST_ASSERT_EQUAL(entry.code, test_data[size - 1]);
+    // Aliases decode as the entry they share an encoding with
+    const Fixed& first = FIXED[fixed_index(entry.prefix, entry.code)];
+    Instruction inst_out;
+    TEST_ASSERT_EQUAL(size, dasm_instruction<TestAPI>(inst_out, 0));
+    TEST_ASSERT_EQUAL(first.mnemonic, inst_out.mnemonic);
+    TEST_ASSERT_EQUAL(first.op1, inst_out.operands[0].token);
+    TEST_ASSERT_EQUAL(first.op2, inst_out.operands[1].token);
+  }
+
+  // Instructions with only fixed forms take no other operands
+  Instruction inst = {MNE_NOP, {TOK_A}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<TestAPI>(inst, 0));
+  // while other forms of the same mnemonic fall through to the encoder
+  inst = {MNE_LD, {TOK_A}, {TOK_B}};
+  TEST_ASSERT_EQUAL(1, asm_instruction<TestAPI>(inst, 0));
+  TEST_ASSERT_EQUAL_HEX8(0x78, test_data[0]);
+  inst = {MNE_RET, {TOK_NZ}};
+  TEST_ASSERT_EQUAL(1, asm_instruction<TestAPI>(inst, 0));
+  TEST_ASSERT_EQUAL_HEX8(0xC0, test_data[0]);
+  inst = {MNE_LD, {TOK_I}, {TOK_B}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<TestAPI>(inst, 0));
+
+  // Data pseudo-ops write their operands; DS is only for the disassembler
+  inst = {MNE_DB, {TOK_IMMEDIATE, 0x12}, {TOK_IMMEDIATE, 0x34}};
+  TEST_ASSERT_EQUAL(2, asm_instruction<TestAPI>(inst, 0));
+  TEST_ASSERT_EQUAL_MEMORY("\x12\x34", test_data, 2);
+  inst = {MNE_DW, {TOK_IMMEDIATE, 0x1234}};
+  TEST_ASSERT_EQUAL(2, asm_instruction<TestAPI>(inst, 0));
+  TEST_ASSERT_EQUAL_MEMORY("\x34\x12", test_data, 2);
+  inst = {MNE_DB, {TOK_A}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<TestAPI>(inst, 0));
+  inst = {MNE_DB, {TOK_IMMEDIATE, 0x1234}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<TestAPI>(inst, 0));
+  inst = {MNE_DS, {TOK_IMMEDIATE, 4}, {TOK_IMMEDIATE, 0}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<TestAPI>(inst, 0));
+}
+
 // NOTE can't use TOK_STR since (HL) is encoded as TOK_HL | TOK_INDIRECT
 const char* REG_STR[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
 
@@ -321,6 +395,1207 @@ void test_asm_inc_r() {
   }
 }
 
+void test_stack() {
+  static const uint8_t code[] = {
+    0xCD, 0x10, 0x00, // 00: CALL $0010
+    0xF5,             // 03: PUSH AF
+    0xCD, 0x10, 0x00, // 04: CALL $0010
+    0xF1,             // 07: POP AF
+    0x28, 0x01,       // 08: JR Z,$000B
+    0xC9,             // 0A: RET
+    0xE9,             // 0B: JP (HL)
+    0x00, 0x00, 0x00, 0x00,
+    0xC5,             // 10: PUSH BC
+    0xD5,             // 11: PUSH DE
+    0xD1,             // 12: POP DE
+    0xC1,             // 13: POP BC
+    0xC9,             // 14: RET
+    0xCD, 0x15, 0x00, // 15: CALL $0015
+    0xC9,             // 18: RET
+  };
+  memcpy(test_data, code, sizeof(code));
+
+  StackAnalyzer<TestAPI> analyzer;
+  StackResult leaf = analyzer.analyze(0x10);
+  TEST_ASSERT_EQUAL(4, leaf.depth);
+  TEST_ASSERT_EQUAL(0, leaf.flags);
+
+  // PUSH AF + CALL + PUSH BC + PUSH DE
+  StackResult main = analyzer.analyze(0x00);
+  TEST_ASSERT_EQUAL(8, main.depth);
+  TEST_ASSERT_EQUAL(STACK_INDIRECT, main.flags);
+  TEST_ASSERT_EQUAL(0x0B, main.flag_addr);
+
+  StackResult loop = analyzer.analyze(0x15);
+  TEST_ASSERT_EQUAL(2, loop.depth);
+  TEST_ASSERT_EQUAL(STACK_RECURSION, loop.flags);
+}
+
+void test_dasm_prev() {
+  // Fill memory with LD HL,$1234
+  for (uint16_t i = 0; i < DATA_SIZE; ++i) {
+    test_data[i] = "\x21\x34\x12"[i % 3];
+  }
+
+  // Resynchronize with unknown code
+  TEST_ASSERT_EQUAL(0x24, dasm_prev<TestAPI>(0x30, 4));
+
+  // Known boundaries are dropped after memory changes
+  memset(test_data + 0x24, 0, 12);
+  TEST_ASSERT_EQUAL(0x2C, dasm_prev<TestAPI>(0x30, 4));
+
+  // More rows than the map holds
+  for (uint16_t i = 0; i < DATA_SIZE; ++i) {
+    test_data[i] = "\x21\x34\x12"[i % 3];
+  }
+  TEST_ASSERT_EQUAL(0x18, dasm_prev<TestAPI>(0x90, 40));
+
+  // Step over known instructions
+  BoundaryMap<4> map;
+  map.mark(0x40, 3);
+  map.mark(0x43, 1);
+  map.mark(0x44, 4);
+  uint16_t start = 0;
+  TEST_ASSERT_EQUAL(3, map.find_prev(0x48, 4, start));
+  TEST_ASSERT_EQUAL(0x40, start);
+  TEST_ASSERT_EQUAL(1, map.find_prev(0x44, 1, start));
+  TEST_ASSERT_EQUAL(0x43, start);
+  TEST_ASSERT_EQUAL(0, map.find_prev(0x40, 1, start));
+}
+
+void test_dasm_length() {
+  // Compare fast length decoder with full decoder for each prefix
+  static const uint8_t PREFIXES[] = { 0, PREFIX_IX, PREFIX_IY, PREFIX_ED, PREFIX_CB };
+  memset(test_data, 0, DATA_SIZE);
+  for (uint8_t prefix : PREFIXES) {
+    for (uint16_t code = 0; code < 256; ++code) {
+      uint8_t offset = prefix != 0;
+      test_data[0] = prefix;
+      test_data[offset] = code;
+      Instruction inst;
+      uint8_t size = dasm_instruction<TestAPI>(inst, 0);
+      TEST_ASSERT_EQUAL_MESSAGE(size, dasm_length<TestAPI>(0), MNE_STR[inst.mnemonic % MNE_INVALID]);
+    }
+  }
+}
+
+void test_instruction_range() {
+  memset(test_data, 0, DATA_SIZE);
+  test_data[0xFC] = 0x00; // FFFC: NOP
+  test_data[0xFD] = 0xC3; // FFFD: JP $1234
+  test_data[0xFE] = 0x34;
+  test_data[0xFF] = 0x12;
+  test_data[0x00] = 0x3E; // 0000: LD A,$00
+
+  // Iterate across wrap-around, stopping after instruction that overlaps end
+  static const uint16_t ADDRS[] = { 0xFFFC, 0xFFFD, 0x0000 };
+  static const uint8_t MNEMONICS[] = { MNE_NOP, MNE_JP, MNE_LD };
+  InstructionRange<TestAPI> range(0xFFFC, 0x0001);
+  auto it = range.begin();
+  for (uint8_t i = 0; i < 3; ++i) {
+    TEST_ASSERT_TRUE(it != range.end());
+    TEST_ASSERT_EQUAL(ADDRS[i], it.addr());
+    TEST_ASSERT_EQUAL(MNEMONICS[i], it->mnemonic);
+    ++it;
+  }
+  TEST_ASSERT_TRUE(it == range.end());
+  TEST_ASSERT_EQUAL(0x0002, it.addr());
+
+  // Range ending mid-instruction includes that instruction
+  uint8_t count = 0;
+  for (const Instruction& inst : InstructionRange<TestAPI>(0xFFFC, 0xFFFE)) {
+    TEST_ASSERT_EQUAL(MNEMONICS[count++], inst.mnemonic);
+  }
+  TEST_ASSERT_EQUAL(2, count);
+}
+
+// Counts bulk writes reaching the target
+struct BulkAPI : TestAPI {
+  static uint8_t n_writes;
+  static void write_bytes(uint16_t addr, const uint8_t* buf, uint8_t size) {
+    ++n_writes;
+    TestAPI::write_bytes(addr, buf, size);
+  }
+};
+
+uint8_t BulkAPI::n_writes;
+
+void test_asm_stage() {
+  memset(test_data, 0, DATA_SIZE);
+  BulkAPI::n_writes = 0;
+
+  // Instruction is committed with one write
+  Instruction inst = {MNE_LD, {TOK_IX_IND, 5}, {TOK_IMMEDIATE, 0x12}};
+  TEST_ASSERT_EQUAL(4, asm_instruction<BulkAPI>(inst, 0x10));
+  TEST_ASSERT_EQUAL(1, BulkAPI::n_writes);
+  TEST_ASSERT_EQUAL_MEMORY("\xDD\x36\x05\x12", test_data + 0x10, 4);
+
+  // Nothing is written on error
+  inst = {MNE_LD, {TOK_BC_IND}, {TOK_B}};
+  TEST_ASSERT_EQUAL(0, asm_instruction<BulkAPI>(inst, 0x20));
+  TEST_ASSERT_EQUAL(1, BulkAPI::n_writes);
+
+  // Batch is committed with one write per block
+  test_input = "LD B,3\nDJNZ $0022\nLD (IX+5),$12\nRET\n.\n";
+  TEST_ASSERT_EQUAL(0x29, asm_batch<BulkAPI>(0x20));
+  TEST_ASSERT_EQUAL(2, BulkAPI::n_writes);
+  TEST_ASSERT_EQUAL_MEMORY("\x06\x03\x10\xFE\xDD\x36\x05\x12\xC9", test_data + 0x20, 9);
+}
+
+uMON_Z80_ASM(TestCode, 0x40,
+  "start: LD B,3 ; count\n"
+  "loop:  LD A,(IX-2)\n"
+  "       OUT ($FE),A\n"
+  "\n"
+  "       DJNZ loop\n"
+  "       JR NZ,start\n"
+  "       LD (IY+1),';'\n"
+  "       SET 7,(IX+3)\n"
+  "       LDIR\n"
+  "       EX AF,AF\n"
+  "       LD (DE),A\n"
+  "       LD A,I\n"
+  "       CALL done\n"
+  "done:  RET");
+
+void test_casm() {
+  static const uint8_t code[] = {
+    0x06, 0x03,             // 40: LD B,$03
+    0xDD, 0x7E, 0xFE,       // 42: LD A,(IX-$02)
+    0xD3, 0xFE,             // 45: OUT ($FE),A
+    0x10, 0xF9,             // 47: DJNZ loop
+    0x20, 0xF5,             // 49: JR NZ,start
+    0xFD, 0x36, 0x01, 0x3B, // 4B: LD (IY+$01),';'
+    0xDD, 0xCB, 0x03, 0xFE, // 4F: SET 7,(IX+$03)
+    0xED, 0xB0,             // 53: LDIR
+    0x08,                   // 55: EX AF,AF
+    0x12,                   // 56: LD (DE),A
+    0xED, 0x57,             // 57: LD A,I
+    0xCD, 0x5C, 0x00,       // 59: CALL done
+    0xC9,                   // 5C: RET
+  };
+  TEST_ASSERT_EQUAL(sizeof(code), TestCode::SIZE);
+  TEST_ASSERT_EQUAL_MEMORY(code, TestCode::code, sizeof(code));
+
+  memset(test_data, 0, DATA_SIZE);
+  BulkAPI::n_writes = 0;
+  casm::upload<BulkAPI, TestCode>();
+  TEST_ASSERT_EQUAL(1, BulkAPI::n_writes);
+  TEST_ASSERT_EQUAL_MEMORY(code, test_data + 0x40, sizeof(code));
+}
+
+void test_asm_batch() {
+  static const uint8_t code[] = {
+    0x06, 0x03,             // 10: LD B,$03
+    0x10, 0xFE,             // 12: DJNZ loop
+    0x18, 0x02,             // 14: JR done
+    0x3E, 0x3B,             // 16: LD A,';'
+    0xC9,                   // 18: RET
+    0xC3, 0x12, 0x00,       // 19: JP loop
+  };
+  memset(test_data, 0, DATA_SIZE);
+  test_input =
+    "start: LD B,3\r\n"
+    "loop:  DJNZ loop ; comment\r\n"
+    "\tJR done\r\n"
+    "       LD A,';'\r\n"
+    "done:\r\n"
+    "  RET\r\n"
+    "  JP loop\r\n"
+    ".\r\n";
+  TEST_ASSERT_EQUAL(0x1C, asm_batch<TestAPI>(0x10));
+  TEST_ASSERT_EQUAL_MEMORY(code, test_data + 0x10, sizeof(code));
+  uint16_t addr;
+  TEST_ASSERT_TRUE(TestAPI::get_labels().get_addr("done", addr));
+  TEST_ASSERT_EQUAL(0x18, addr);
+
+  // Nothing is written if a line fails to assemble
+  memset(test_data, 0, DATA_SIZE);
+  test_input = "NOP\nLD (BC),B\nNOP\n.\n";
+  test_log.clear();
+  TEST_ASSERT_EQUAL(0x10, asm_batch<LogAPI>(0x10));
+  TEST_ASSERT_EQUAL(0, test_data[0x10]);
+  // and the line is reported once, after its prompt
+  TEST_ASSERT_EQUAL_STRING(" 0010  \n 0011  \nasm: LD (BC),B?\n 0011  \n 0011  \n", test_log.contents());
+
+  // Undefined labels fail in the second pass
+  test_input = "JP nowhere\n.\n";
+  TEST_ASSERT_EQUAL(0x10, asm_batch<TestAPI>(0x10));
+
+  // Labels are put back after a failed batch
+  test_input = "here: LD B,3\nloop: JP nowhere\n.\n";
+  TEST_ASSERT_EQUAL(0x40, asm_batch<TestAPI>(0x40));
+  TEST_ASSERT_EQUAL(0, test_data[0x40]);
+  TEST_ASSERT_FALSE(TestAPI::get_labels().get_addr("here", addr));
+  TEST_ASSERT_TRUE(TestAPI::get_labels().get_addr("loop", addr));
+  TEST_ASSERT_EQUAL(0x12, addr);
+
+  // JR out of reach only at its final address fails before writing
+  static char source[512] = "";
+  for (uint8_t i = 0; i < 10; ++i) strcat(source, "DW 1,1\n");
+  strcat(source, "JR far\n");
+  for (uint8_t i = 0; i < 33; ++i) strcat(source, "DW 1,1\n");
+  strcat(source, "far: RET\n.\n");
+  test_input = source;
+  TEST_ASSERT_EQUAL(0x10, (asm_batch<TestAPI, 512>(0x10)));
+  TEST_ASSERT_EQUAL(0, test_data[0x10]);
+  TEST_ASSERT_FALSE(TestAPI::get_labels().get_addr("far", addr));
+
+  TestAPI::get_labels().remove_label("start");
+  TestAPI::get_labels().remove_label("loop");
+  TestAPI::get_labels().remove_label("done");
+}
+
+void test_asm_relax() {
+  static const uint8_t code[] = {
+    0x18, 0x08,             // 10: JR done
+    0x20, 0xFC,             // 12: JR NZ,start
+    0xEA, 0x10, 0x00,       // 14: JP PE,start (no JR form)
+    0xC3, 0x00, 0x12,       // 17: JP $1200 (too far)
+    0xC9,                   // 1A: RET
+  };
+  memset(test_data, 0, DATA_SIZE);
+  test_input =
+    "start: JP done\n"
+    "       jp nz,start\n"
+    "       JP PE,start\n"
+    "       JP $1200\n"
+    "done:  RET\n"
+    ".\n";
+  TEST_ASSERT_EQUAL(0x1B, asm_batch<TestAPI>(0x10, true));
+  TEST_ASSERT_EQUAL_MEMORY(code, test_data + 0x10, sizeof(code));
+
+  // Relaxing a later jump brings an earlier one into reach
+  static char source[400];
+  strcpy(source, "start: JP done\nJP start\n");
+  for (uint8_t i = 0; i < 31; ++i) {
+    strcat(source, "LD (IX),0\n");
+  }
+  strcat(source, "done: RET\n.\n");
+  test_input = source;
+  TEST_ASSERT_EQUAL(0x91, (asm_batch<TestAPI, 512>(0x10, true)));
+
+  // Check the code written by decoding it again
+  static const uint8_t MNEMONICS[] = { MNE_JR, MNE_JR, MNE_LD };
+  InstructionRange<TestAPI> range(0x10, 0x90);
+  auto it = range.begin();
+  for (uint8_t mnemonic : MNEMONICS) {
+    TEST_ASSERT_EQUAL(mnemonic, it->mnemonic);
+    ++it;
+  }
+  TEST_ASSERT_EQUAL(0x90, range.begin()->operands[0].value);
+  uint16_t addr;
+  TEST_ASSERT_TRUE(TestAPI::get_labels().get_addr("done", addr));
+  TEST_ASSERT_EQUAL(0x90, addr);
+
+  TestAPI::get_labels().remove_label("start");
+  TestAPI::get_labels().remove_label("done");
+}
+
+void test_fixups() {
+  memset(test_data, 0, DATA_SIZE);
+  auto assemble = [](const char* str, uint16_t addr) {
+    static char line[24];
+    strcpy(line, str);
+    test_io.clear();
+    uCLI::Tokens args(line);
+    Instruction inst;
+    const char* symbols[MAX_OPERANDS] = {};
+    TEST_ASSERT_TRUE_MESSAGE(parse_instruction<TestAPI>(inst, args, symbols), str);
+    return asm_fixup<TestAPI>(inst, symbols, addr);
+  };
+  auto& fixups = TestAPI::get_fixups();
+
+  // Undefined names assemble as zero with a pending fixup
+  TEST_ASSERT_EQUAL(3, assemble("CALL fwd", 0x20));
+  TEST_ASSERT_EQUAL_STRING("fwd?\n", test_io.contents());
+  TEST_ASSERT_EQUAL(2, assemble("JR NZ,fwd", 0x23));
+  TEST_ASSERT_EQUAL(2, assemble("LD A,fwd", 0x25));
+  TEST_ASSERT_EQUAL(4, assemble("LD (IX+1),fwd", 0x27));
+  TEST_ASSERT_EQUAL(1, assemble("NOP", 0x2B));
+  TEST_ASSERT_EQUAL(4, fixups.entries());
+  TEST_ASSERT_EQUAL(0, test_data[0x21]);
+  TEST_ASSERT_EQUAL(0, test_data[0x24]);
+
+  // Nothing is written when the reference cannot be kept
+  TEST_ASSERT_EQUAL(0, assemble("JP fwd", 0x2C)); // fixups full
+  TEST_ASSERT_EQUAL(0, assemble("RST fwd", 0x2C)); // no immediate
+  TEST_ASSERT_EQUAL(0, assemble("IM fwd", 0x2C));
+  TEST_ASSERT_EQUAL(0, assemble("LD (aa),bb", 0x2C)); // two names
+  TEST_ASSERT_EQUAL(0, test_data[0x2C]);
+  TEST_ASSERT_EQUAL(4, fixups.entries());
+
+  // Overwriting code forgets its fixups
+  TEST_ASSERT_EQUAL(4, assemble("LD IX,0", 0x27));
+  TEST_ASSERT_EQUAL(3, fixups.entries());
+  TEST_ASSERT_EQUAL(2, assemble("LD B,fwd", 0x27));
+  TEST_ASSERT_EQUAL(4, assemble("LD IX,0", 0x27));
+  TEST_ASSERT_EQUAL(3, fixups.entries());
+
+  // Defining the name patches every reference
+  uMon::resolve_fixups<TestAPI>("fwd", 0x1234);
+  static const uint8_t code[] = {
+    0xCD, 0x34, 0x12,       // 20: CALL $1234
+    0x20, 0x00,             // 23: JR NZ,$1234 (too far)
+    0x3E, 0x34,             // 25: LD A,$34
+  };
+  TEST_ASSERT_EQUAL_MEMORY(code, test_data + 0x20, sizeof(code));
+  TEST_ASSERT_EQUAL(0, fixups.entries());
+
+  TEST_ASSERT_EQUAL(2, assemble("DJNZ back", 0x40));
+  uMon::resolve_fixups<TestAPI>("back", 0x3E);
+  TEST_ASSERT_EQUAL(0xFC, test_data[0x41]);
+  TEST_ASSERT_EQUAL(0, fixups.entries());
+}
+
+void test_reloc() {
+  static const uint8_t code[] = {
+    0x21, 0x18, 0x00,       // 10: LD HL,table
+    0xCD, 0x34, 0x12,       // 13: CALL $1234
+    0x18, 0xF8,             // 16: JR $0010
+    0x10, 0x00,             // 18: table: DW $0010
+    0x10, 0x00,             // 1A: DB $10,$00
+    0x3A, 0x1C, 0x00,       // 1C: LD A,($001C)
+  };
+  static const uint8_t moved[] = {
+    0x21, 0x88, 0x00,
+    0xCD, 0x34, 0x12,
+    0x18, 0xF8,
+    0x80, 0x00,
+    0x10, 0x00,
+    0x3A, 0x8C, 0x00,
+  };
+  memset(test_data, 0, DATA_SIZE);
+  memcpy(test_data + 0x10, code, sizeof(code));
+  auto& regions = TestAPI::get_regions();
+  regions.mark(0x18, 0x19, uMon::REGION_WORD);
+  regions.mark(0x1A, 0x1B, uMon::REGION_BYTE);
+  TEST_ASSERT_EQUAL(3, reloc_range<TestAPI>(0x10, 0x1E, 0x80));
+  TEST_ASSERT_EQUAL_MEMORY(moved, test_data + 0x80, sizeof(moved));
+
+  // Overlapping move
+  memcpy(test_data + 0x10, code, sizeof(code));
+  TEST_ASSERT_EQUAL(3, reloc_range<TestAPI>(0x10, 0x1E, 0x14));
+  TEST_ASSERT_EQUAL(0x1C, test_data[0x15]);
+  TEST_ASSERT_EQUAL(0x14, test_data[0x1C]);
+  TEST_ASSERT_EQUAL(0x20, test_data[0x21]);
+  regions.mark(0x00, 0xFF, uMon::REGION_CODE);
+}
+
+uMON_Z80_ASM(EmuCode, 0x40,
+  "       LD SP,$0000\n"
+  "       LD B,10\n"
+  "       XOR A\n"
+  "loop:  ADD A,B\n"
+  "       DJNZ loop\n"
+  "       LD ($F0),A\n"
+  "       CALL sub\n"
+  "       HALT\n"
+  "sub:   LD HL,$1234\n"
+  "       PUSH HL\n"
+  "       POP DE\n"
+  "       RET");
+
+uMON_Z80_ASM(EmuFlags, 0x80,
+  "       LD A,$15\n"
+  "       ADD A,$27\n"
+  "       DAA\n"
+  "       LD ($F0),A\n"
+  "       SUB $50\n"
+  "       LD IX,$00E0\n"
+  "       LD (IX+2),$7F\n"
+  "       INC (IX+2)\n"
+  "       SET 0,(IX+2)\n"
+  "       LD HL,$00E2\n"
+  "       LD DE,$00E8\n"
+  "       LD BC,2\n"
+  "       LDIR\n"
+  "       HALT");
+
+void test_emu() {
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuCode>();
+  Cpu<TestAPI> cpu;
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(55, cpu.a);
+  TEST_ASSERT_EQUAL(55, test_data[0xF0]);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, cpu.de());
+  TEST_ASSERT_EQUAL_HEX16(0x0000, cpu.sp);
+  TEST_ASSERT_EQUAL_HEX16(EmuCode::ORG + 0x10, cpu.pc);
+  TEST_ASSERT_EQUAL(261, cpu.cycles);
+
+  // Stop at address, then wake from HALT by interrupt
+  cpu.reset();
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_UNTIL, cpu.run(EmuCode::ORG + 5, 1000));
+  TEST_ASSERT_EQUAL(17, cpu.cycles);
+  TEST_ASSERT_EQUAL(RUN_CYCLES, cpu.run(0xFFFF, 10));
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  cpu.nmi();
+  TEST_ASSERT_EQUAL(11, cpu.step());
+  TEST_ASSERT_EQUAL_HEX16(0x0066, cpu.pc);
+  TEST_ASSERT_FALSE(cpu.is_halted);
+
+  // Flags and indexed memory
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuFlags>();
+  cpu.reset();
+  cpu.pc = EmuFlags::ORG;
+  TEST_ASSERT_EQUAL(RUN_UNTIL, cpu.run(EmuFlags::ORG + 10, 1000));
+  TEST_ASSERT_EQUAL_HEX8(0x42, test_data[0xF0]);
+  TEST_ASSERT_EQUAL_HEX8(0xF2, cpu.a);
+  TEST_ASSERT_EQUAL_HEX8(FLAG_S | FLAG_Y | FLAG_N | FLAG_C, cpu.f);
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL_HEX8(0x81, test_data[0xE2]);
+  TEST_ASSERT_EQUAL_HEX8(0x81, test_data[0xE8]);
+  TEST_ASSERT_EQUAL_HEX16(0, cpu.bc());
+  TEST_ASSERT_EQUAL_HEX16(0xE4, cpu.hl());
+}
+
+uMON_Z80_ASM(EmuPatch, 0x40,
+  "       XOR A\n"
+  "       LD B,2\n"
+  "loop:  NOP\n"
+  "       LD HL,loop\n"
+  "       LD (HL),$3C ; INC A\n"
+  "       DJNZ loop\n"
+  "       HALT");
+
+uMON_Z80_ASM(EmuIndex, 0x40,
+  "       LD IX,$0080\n"
+  "       LD IY,$0098\n"
+  "       LD DE,$0101\n"
+  "       LD B,4\n"
+  "       XOR A\n"
+  "loop:  ADD A,(IX+0)\n"
+  "       LD (IY+1),A\n"
+  "       LD C,(IX+1)\n"
+  "       SUB (IY-8)\n"
+  "       INC IX\n"
+  "       DEC IY\n"
+  "       ADD HL,DE\n"
+  "       ADD IY,DE\n"
+  "       ADD IX,IX\n"
+  "       DJNZ loop\n"
+  "       HALT");
+
+void test_emu_cache() {
+  // Cached blocks agree with interpreter
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuCode>();
+  Cpu<TestAPI, 16> cpu;
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_UNTIL, cpu.run(EmuCode::ORG + 5, 1000));
+  TEST_ASSERT_EQUAL(17, cpu.cycles);
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(55, cpu.a);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, cpu.de());
+  TEST_ASSERT_EQUAL(261, cpu.cycles);
+
+  // Code written around the Cpu is decoded again after invalidate
+  test_data[0x44] = 5; // LD B,5
+  cpu.invalidate(0x44, 0x44);
+  cpu.pc = EmuCode::ORG;
+  cpu.is_halted = false;
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(15, cpu.a);
+
+  // Code written by itself is decoded again
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuPatch>();
+  cpu.reset();
+  cpu.pc = EmuPatch::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(1, cpu.a);
+
+  // Pre-decoded IX/IY forms agree with interpreter
+  static uint8_t plain_data[DATA_SIZE];
+  memset(test_data, 0, DATA_SIZE);
+  for (uint8_t i = 0; i < 0x40; ++i) test_data[0x80 + i] = i * 37;
+  casm::upload<TestAPI, EmuIndex>();
+  Cpu<TestAPI> plain;
+  plain.pc = EmuIndex::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, plain.run(0xFFFF, 10000));
+  memcpy(plain_data, test_data, DATA_SIZE);
+  memset(test_data, 0, DATA_SIZE);
+  for (uint8_t i = 0; i < 0x40; ++i) test_data[0x80 + i] = i * 37;
+  casm::upload<TestAPI, EmuIndex>();
+  cpu.reset();
+  cpu.pc = EmuIndex::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 10000));
+  TEST_ASSERT_EQUAL_MEMORY(plain_data, test_data, DATA_SIZE);
+  TEST_ASSERT_EQUAL_HEX8(plain.a, cpu.a);
+  TEST_ASSERT_EQUAL_HEX8(plain.f, cpu.f);
+  TEST_ASSERT_EQUAL_HEX8(plain.c, cpu.c);
+  TEST_ASSERT_EQUAL_HEX16(plain.hl(), cpu.hl());
+  TEST_ASSERT_EQUAL_HEX16(plain.ix, cpu.ix);
+  TEST_ASSERT_EQUAL_HEX16(plain.iy, cpu.iy);
+  TEST_ASSERT_EQUAL_HEX8(plain.r, cpu.r);
+  TEST_ASSERT_EQUAL(plain.cycles, cpu.cycles);
+}
+
+void test_profile() {
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuCode>();
+  auto& labels = TestAPI::get_labels();
+  const char* name;
+  uint16_t addr;
+  while (labels.get_index(0, name, addr)) labels.remove_label(name);
+  labels.set_label("start", 0x40);
+  labels.set_label("sub", 0x50);
+
+  static Profiler<TestAPI> profile;
+  Cpu<TestAPI> cpu;
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, profile.run(cpu, 0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(10, profile.count(0x46)); // ADD A,B
+  TEST_ASSERT_EQUAL(125, profile.cycles(0x47)); // DJNZ
+
+  // Grouped by label, most T-states first
+  ProfileGroup groups[4];
+  TEST_ASSERT_EQUAL(2, profile.group(groups, 4));
+  TEST_ASSERT_EQUAL_STRING("start", groups[0].name);
+  TEST_ASSERT_EQUAL(26, groups[0].count);
+  TEST_ASSERT_EQUAL(220, groups[0].cycles);
+  TEST_ASSERT_EQUAL_STRING("sub", groups[1].name);
+  TEST_ASSERT_EQUAL(4, groups[1].count);
+  TEST_ASSERT_EQUAL(41, groups[1].cycles);
+
+  // A label splits code at any address
+  labels.set_label("loop", 0x46);
+  TEST_ASSERT_EQUAL(3, profile.group(groups, 4));
+  TEST_ASSERT_EQUAL_STRING("loop", groups[0].name);
+  TEST_ASSERT_EQUAL(199, groups[0].cycles);
+  TEST_ASSERT_EQUAL_STRING("sub", groups[1].name);
+  TEST_ASSERT_EQUAL_STRING("start", groups[2].name);
+  TEST_ASSERT_EQUAL(3, groups[2].count);
+  TEST_ASSERT_EQUAL(21, groups[2].cycles);
+  labels.remove_label("loop");
+
+  // Code before first label is grouped from $0000
+  labels.remove_label("start");
+  TEST_ASSERT_EQUAL(1, profile.group(groups, 1));
+  TEST_ASSERT_TRUE(groups[0].name == nullptr);
+  TEST_ASSERT_EQUAL(0, groups[0].start);
+  TEST_ASSERT_EQUAL(220, groups[0].cycles);
+
+  // Coarse buckets are reported one by one, named only by a label at their
+  // first byte; "loop" inside the first bucket gets no group of its own
+  static Profiler<TestAPI, 0, 16, 4> coarse;
+  labels.set_label("loop", 0x46);
+  cpu.reset();
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, coarse.run(cpu, 0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(26, coarse.count(0x46));
+  TEST_ASSERT_EQUAL(0, coarse.count(0x100));
+  TEST_ASSERT_EQUAL(2, coarse.group(groups, 4));
+  TEST_ASSERT_TRUE(groups[0].name == nullptr);
+  TEST_ASSERT_EQUAL_HEX16(0x40, groups[0].start);
+  TEST_ASSERT_EQUAL(220, groups[0].cycles);
+  TEST_ASSERT_EQUAL_STRING("sub", groups[1].name);
+  TEST_ASSERT_EQUAL(41, groups[1].cycles);
+  labels.remove_label("loop");
+  labels.remove_label("sub");
+
+  // Time halted with interrupts enabled is idle, not charged to a PC
+  profile.clear();
+  cpu.is_halted = true;
+  cpu.iff1 = true;
+  const uint16_t pc = cpu.pc;
+  TEST_ASSERT_EQUAL(RUN_CYCLES, profile.run(cpu, 0xFFFF, 100));
+  TEST_ASSERT_EQUAL(100, profile.idle_cycles());
+  TEST_ASSERT_EQUAL(0, profile.count(pc));
+}
+
+// Counts bytes read and where the last read ended
+struct ReadAPI : TestAPI {
+  static uint16_t n_read;
+  static uint16_t last;
+
+  static void clear() { n_read = 0; last = 0; }
+
+  static void note(uint16_t addr, uint8_t size) {
+    n_read += size;
+    last = addr + size - 1;
+  }
+
+  static uint8_t read_byte(uint16_t addr) {
+    note(addr, 1);
+    return TestAPI::read_byte(addr);
+  }
+
+  template <uint8_t N>
+  static void read_bytes(uint16_t addr, uint8_t (&buf)[N]) {
+    note(addr, N);
+    TestAPI::read_bytes(addr, buf);
+  }
+};
+
+uint16_t ReadAPI::n_read;
+uint16_t ReadAPI::last;
+
+void test_snapshot() {
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuCode>();
+  Cpu<TestAPI, 16> cpu;
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_UNTIL, cpu.run(EmuCode::ORG + 5, 1000));
+  cpu.irq(0xCF);
+
+  // Zeros around the code pack into repeat runs
+  static uint8_t blob[snapshot_max_size(DATA_SIZE)];
+  const uint32_t size = save_snapshot(cpu, 0x00, 0xFF, blob, sizeof(blob));
+  TEST_ASSERT_EQUAL(SNAPSHOT_HEADER + 2 + 1 + EmuCode::SIZE + 2 + 2, size);
+  TEST_ASSERT_EQUAL(0, save_snapshot(cpu, 0x00, 0xFF, blob, size - 1));
+
+  // Fork from snapshot twice with the same result
+  for (uint8_t i = 0; i < 2; ++i) {
+    cpu.reset();
+    memset(test_data, 0xFF, DATA_SIZE);
+    TEST_ASSERT_TRUE(load_snapshot(cpu, blob, size));
+    TEST_ASSERT_EQUAL_HEX16(EmuCode::ORG + 5, cpu.pc);
+    TEST_ASSERT_EQUAL(10, cpu.b);
+    TEST_ASSERT_EQUAL(17, cpu.cycles);
+    TEST_ASSERT_TRUE(cpu.is_irq);
+    TEST_ASSERT_EQUAL_HEX8(0xCF, cpu.irq_data);
+    TEST_ASSERT_EQUAL_MEMORY(EmuCode::code, test_data + EmuCode::ORG, EmuCode::SIZE);
+    TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+    TEST_ASSERT_EQUAL(55, cpu.a);
+    TEST_ASSERT_EQUAL(261, cpu.cycles);
+  }
+
+  // Truncated or foreign blobs are rejected
+  TEST_ASSERT_FALSE(load_snapshot(cpu, blob, size - 1));
+  blob[0] = 'X';
+  TEST_ASSERT_FALSE(load_snapshot(cpu, blob, size));
+
+  // Memory is read up to end and no further, without wrapping
+  SnapshotWriter out = { blob, blob + sizeof(blob), false };
+  ReadAPI::clear();
+  save_memory<ReadAPI>(out, 0x10, 0x4A);
+  TEST_ASSERT_EQUAL(0x3B, ReadAPI::n_read);
+  TEST_ASSERT_EQUAL_HEX16(0x4A, ReadAPI::last);
+  ReadAPI::clear();
+  save_memory<ReadAPI>(out, 0xFFF0, 0xFFFF);
+  TEST_ASSERT_EQUAL(0x10, ReadAPI::n_read);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, ReadAPI::last);
+}
+
+// Adds a UART at $10 and a timer at $20 to the test target
+struct PortAPI : TestAPI {
+  static UartFifo<0x10, 4> uart;
+  static Timer<0x20> timer;
+  static uint8_t read_port(uint16_t port) { return port_read(port, uart, timer); }
+  static void write_port(uint16_t port, uint8_t data) { port_write(port, data, uart, timer); }
+  static bool tick_devices(uint8_t cycles, uint8_t& data) { return port_tick(cycles, data, uart, timer); }
+};
+
+UartFifo<0x10, 4> PortAPI::uart;
+Timer<0x20> PortAPI::timer;
+
+uMON_Z80_ASM(PortIsr, 0x38,
+  "       INC E\n"
+  "       EI\n"
+  "       RETI");
+
+uMON_Z80_ASM(PortCode, 0x40,
+  "       LD SP,$0000\n"
+  "       IM 1\n"
+  "       LD HL,$00A0\n"
+  "       LD BC,$0310\n"
+  "       OTIR\n"
+  "wait:  IN A,($11)\n"
+  "       AND 1\n"
+  "       JR Z,wait\n"
+  "       IN A,($10)\n"
+  "       OUT ($10),A\n"
+  "       LD A,100\n"
+  "       OUT ($20),A\n"
+  "       XOR A\n"
+  "       OUT ($21),A\n"
+  "       LD A,3\n"
+  "       OUT ($22),A\n"
+  "       LD E,0\n"
+  "       EI\n"
+  "loop:  LD A,E\n"
+  "       CP 3\n"
+  "       JR NZ,loop\n"
+  "       DI\n"
+  "       HALT");
+
+uMON_Z80_ASM(PortIdle, 0x40,
+  "       LD SP,$0000\n"
+  "       IM 1\n"
+  "       LD A,100\n"
+  "       OUT ($20),A\n"
+  "       XOR A\n"
+  "       OUT ($21),A\n"
+  "       LD A,3\n"
+  "       OUT ($22),A\n"
+  "       LD E,0\n"
+  "idle:  EI\n"
+  "       HALT\n"
+  "       LD A,E\n"
+  "       CP 3\n"
+  "       JR NZ,idle\n"
+  "       DI\n"
+  "       HALT");
+
+void test_ports() {
+  memset(test_data, 0, DATA_SIZE);
+  memcpy(test_data + 0xA0, "abc", 3);
+  casm::upload<TestAPI, PortIsr>();
+  casm::upload<TestAPI, PortCode>();
+  Cpu<PortAPI, 16> cpu;
+  cpu.pc = PortCode::ORG;
+
+  // Poll UART until host sends a byte
+  TEST_ASSERT_EQUAL(RUN_CYCLES, cpu.run(0xFFFF, 500));
+  TEST_ASSERT_TRUE(PortAPI::uart.send('x'));
+
+  // Echo byte, then count three timer interrupts
+  TEST_ASSERT_EQUAL(RUN_HALT, cpu.run(0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(3, cpu.e);
+  uint8_t data;
+  for (char c : "abcx") {
+    if (c == '\0') break;
+    TEST_ASSERT_TRUE(PortAPI::uart.receive(data));
+    TEST_ASSERT_EQUAL(c, data);
+  }
+  TEST_ASSERT_FALSE(PortAPI::uart.receive(data));
+  TEST_ASSERT_EQUAL(TIMER_ENABLE | TIMER_IRQ | TIMER_EXPIRED, PortAPI::read_port(0x22));
+  TEST_ASSERT_EQUAL(TIMER_ENABLE | TIMER_IRQ, PortAPI::read_port(0x22));
+
+  // Writes beyond TX FIFO are lost
+  for (uint8_t i = 0; i < 5; ++i) PortAPI::write_port(0x10, i);
+  TEST_ASSERT_EQUAL(0, PortAPI::read_port(0x11)); // RX empty, TX full
+  for (uint8_t i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(PortAPI::uart.receive(data));
+    TEST_ASSERT_EQUAL(i, data);
+  }
+  TEST_ASSERT_EQUAL(UART_TX_READY, PortAPI::read_port(0x11));
+
+  // Timer wakes EI; HALT until the count is reached
+  casm::upload<TestAPI, PortIdle>();
+  Cpu<PortAPI, 16> idle;
+  idle.pc = PortIdle::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, idle.run(0xFFFF, 100000));
+  TEST_ASSERT_EQUAL(3, idle.e);
+  TEST_ASSERT_FALSE(idle.iff1);
+
+  // With nothing to wake it, EI; HALT runs out the budget
+  PortAPI::write_port(0x22, 0);
+  idle.pc = PortIdle::ORG + 18; // idle
+  idle.is_halted = false;
+  const uint32_t start = idle.cycles;
+  TEST_ASSERT_EQUAL(RUN_CYCLES, idle.run(0xFFFF, 1000));
+  TEST_ASSERT_TRUE(idle.is_halted);
+  TEST_ASSERT_TRUE(idle.cycles - start >= 1000);
+}
+
+uMON_Z80_ASM(CasmCases, 0x00,
+  "top:   LD A,(IX-2)\n"
+  "       LD (IY+3),B\n"
+  "       LD IXH,C\n"
+  "       LD (HL),$12\n"
+  "       LD (IX+1),$34\n"
+  "       LD IY,$5678\n"
+  "       LD HL,($1234)\n"
+  "       LD ($1234),IX\n"
+  "       LD DE,($1234)\n"
+  "       LD ($1234),SP\n"
+  "       LD A,($1234)\n"
+  "       LD ($1234),A\n"
+  "       LD A,(BC)\n"
+  "       LD (DE),A\n"
+  "       LD SP,IY\n"
+  "       LD I,A\n"
+  "       LD A,R\n"
+  "       ADD A,B\n"
+  "       SUB (IX+4)\n"
+  "       XOR $0F\n"
+  "       ADD IX,SP\n"
+  "       ADC HL,BC\n"
+  "       SBC HL,DE\n"
+  "       INC (IY-1)\n"
+  "       DEC IXL\n"
+  "       INC SP\n"
+  "       DEC IY\n"
+  "       JP (HL)\n"
+  "       JP (IX)\n"
+  "       JP PE,top\n"
+  "       CALL M,top\n"
+  "       RET\n"
+  "       RET NC\n"
+  "back:  JR back\n"
+  "       JR C,back\n"
+  "       DJNZ back\n"
+  "       RST $38\n"
+  "       PUSH AF\n"
+  "       POP IX\n"
+  "       EX DE,HL\n"
+  "       EX AF,AF\n"
+  "       EX AF\n"
+  "       EX (SP),IY\n"
+  "       IN A,($FE)\n"
+  "       IN B,(C)\n"
+  "       OUT ($FE),A\n"
+  "       OUT (C),E\n"
+  "       IM 2\n"
+  "       RLC (IX+5)\n"
+  "       SRL A\n"
+  "       BIT 3,(HL)\n"
+  "       RES 1,(IY-6)\n"
+  "       NEG\n"
+  "       RETI\n"
+  "       NOP");
+
+// Assemble Source one line at a time with asm_instruction and compare with
+// the bytes casm produced for Code
+template <typename Source, typename Code>
+void check_casm() {
+  static char input[1024];
+  snprintf(input, sizeof(input), "%s\n.\n", Source::text());
+  memset(test_data, 0, DATA_SIZE);
+  test_input = input;
+  TEST_ASSERT_EQUAL_HEX16(Code::ORG + Code::SIZE, (asm_batch<TestAPI, 1024>(Code::ORG)));
+  TEST_ASSERT_EQUAL_MEMORY(Code::code, test_data + Code::ORG, Code::SIZE);
+
+  // Forget labels defined by the source
+  char line[40];
+  for (const char* s = Source::text(); *s != '\0'; ) {
+    const char* e = strchr(s, '\n');
+    const size_t n = e != nullptr ? e - s : strlen(s);
+    memcpy(line, s, n);
+    line[n] = '\0';
+    char* rest = line;
+    const char* label = uMon::z80::split_label(rest);
+    if (label != nullptr) TestAPI::get_labels().remove_label(label);
+    s += e != nullptr ? n + 1 : n;
+  }
+}
+
+void test_casm_match() {
+  check_casm<CasmCases_Source, CasmCases>();
+  check_casm<TestCode_Source, TestCode>();
+  check_casm<EmuCode_Source, EmuCode>();
+  check_casm<EmuFlags_Source, EmuFlags>();
+  check_casm<EmuPatch_Source, EmuPatch>();
+  check_casm<PortIsr_Source, PortIsr>();
+  check_casm<PortCode_Source, PortCode>();
+}
+
+void test_debug() {
+  using Debug = Debugger<TestAPI, 4>;
+  memset(test_data, 0, DATA_SIZE);
+  casm::upload<TestAPI, EmuCode>();
+  Debug::clear();
+  Cpu<Debug::Bus> cpu;
+  cpu.pc = EmuCode::ORG;
+
+  // Break before executing flagged address
+  Debug::set(WATCH_EXEC, 0x50, 0x50);
+  TEST_ASSERT_EQUAL(RUN_BREAK, Debug::run(cpu, 0xFFFF, 1000));
+  TEST_ASSERT_EQUAL_HEX16(0x50, cpu.pc);
+  TEST_ASSERT_EQUAL(WATCH_EXEC, Debug::hit_kind);
+
+  // Resume and break after write to flagged address
+  Debug::set(WATCH_WRITE, 0xFFFC, 0xFFFC);
+  TEST_ASSERT_EQUAL(RUN_BREAK, Debug::run(cpu, 0xFFFF, 1000));
+  TEST_ASSERT_EQUAL_HEX16(0x54, cpu.pc);
+  TEST_ASSERT_EQUAL(WATCH_WRITE, Debug::hit_kind);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFC, Debug::hit_addr);
+  TEST_ASSERT_EQUAL_HEX8(0x34, Debug::hit_data);
+
+  // Conditional trigger, ignoring first hit
+  Debug::clear();
+  Debug::add_trigger({ 0x46, WATCH_EXEC, 1, [](const CpuState& cpu, uint8_t) { return cpu.a >= 40; } });
+  cpu.reset();
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_BREAK, Debug::run(cpu, 0xFFFF, 1000));
+  TEST_ASSERT_EQUAL(45, cpu.a);
+  TEST_ASSERT_EQUAL(4, cpu.b);
+
+  // Fetches are not data reads
+  Debug::clear();
+  Debug::set(WATCH_READ, EmuCode::ORG, EmuCode::ORG + EmuCode::SIZE - 1);
+  TEST_ASSERT_EQUAL(RUN_HALT, Debug::run(cpu, 0xFFFF, 1000));
+
+  // Trace ends with most recent instruction
+  using Last = Debugger<TestAPI, 1>;
+  cpu.reset();
+  cpu.pc = EmuCode::ORG;
+  TEST_ASSERT_EQUAL(RUN_HALT, Last::run(cpu, 0xFFFF, 1000));
+  test_io.clear();
+  Last::print_trace();
+  TEST_ASSERT_EQUAL_STRING(" 004F  HALT\n", test_io.contents());
+}
+
+// Runs stubs on the emulator as the target CPU
+struct TargetAPI : TestAPI {
+  static uint8_t n_runs;
+  static bool run_cpu(uint16_t addr) {
+    Cpu<TestAPI> cpu;
+    cpu.pc = addr;
+    ++n_runs;
+    return cpu.run(0xFFFF, 10000) == RUN_HALT;
+  }
+};
+
+uint8_t TargetAPI::n_runs;
+
+void test_target() {
+  constexpr const uint16_t SCRATCH = 0x10;
+  uint8_t expect[DATA_SIZE];
+  for (uint16_t i = 0; i < DATA_SIZE; ++i) test_data[i] = i;
+  TargetAPI::n_runs = 0;
+
+  // Fill by LDIR, leaving scratch untouched
+  target_memset<TargetAPI, SCRATCH>(0x80, 0x9F, 0xAA);
+  TEST_ASSERT_EQUAL(1, TargetAPI::n_runs);
+  for (uint16_t i = 0; i < DATA_SIZE; ++i) expect[i] = i < 0x80 || i > 0x9F ? i : 0xAA;
+  TEST_ASSERT_EQUAL_MEMORY(expect, test_data, DATA_SIZE);
+
+  // Overlapping moves in both directions match impl_memmove
+  for (uint16_t dest : (const uint16_t[]){ 0x48, 0x38 }) {
+    for (uint16_t i = 0; i < DATA_SIZE; ++i) test_data[i] = i;
+    uMon::impl_memmove<TestAPI>(0x40, 0x5F, dest);
+    memcpy(expect, test_data, DATA_SIZE);
+    for (uint16_t i = 0; i < DATA_SIZE; ++i) test_data[i] = i;
+    target_memmove<TargetAPI, SCRATCH>(0x40, 0x5F, dest);
+    TEST_ASSERT_EQUAL_MEMORY(expect, test_data, DATA_SIZE);
+  }
+  TEST_ASSERT_EQUAL(3, TargetAPI::n_runs);
+
+  // Ranges touching scratch fall back to bus cycles
+  target_memset<TargetAPI, SCRATCH>(0x00, 0x10, 0x55);
+  target_memmove<TargetAPI, SCRATCH>(0x80, 0x8F, 0x0F);
+  TEST_ASSERT_EQUAL(3, TargetAPI::n_runs);
+  TEST_ASSERT_EQUAL_HEX8(0x55, test_data[0x00]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, test_data[0x0F]);
+  TEST_ASSERT_EQUAL_HEX8(0x8F, test_data[0x1E]);
+
+  // Without a CPU to run, the bus is used instead
+  target_memset<TestAPI, SCRATCH>(0x80, 0x9F, 0x11);
+  TEST_ASSERT_EQUAL_HEX8(0x11, test_data[0x9F]);
+  TEST_ASSERT_EQUAL_HEX8(0x88, test_data[0x17]);
+}
+
+void test_sim() {
+  using Sim = uMon::SimAPI<TestAPI>;
+  Sim::model = { 1, 10, 100, 1000000 };
+  Sim::clear();
+  memset(test_data, 0, DATA_SIZE);
+
+  // Latch only when address does not follow the last access
+  Sim::write_byte(0x10, 0x12);
+  TEST_ASSERT_EQUAL(111, Sim::elapsed_ns);
+  TEST_ASSERT_EQUAL_HEX8(0x12, Sim::read_byte(0x10));
+  TEST_ASSERT_EQUAL(222, Sim::elapsed_ns);
+  TEST_ASSERT_EQUAL_HEX8(0x00, Sim::read_byte(0x11));
+  TEST_ASSERT_EQUAL(323, Sim::elapsed_ns);
+
+  // Block transfers take the bus once
+  Sim::write_bytes(0x12, (const uint8_t*)"\x01\x02\x03\x04", 4);
+  TEST_ASSERT_EQUAL(724, Sim::elapsed_ns);
+  TEST_ASSERT_EQUAL_MEMORY("\x12\x00\x01\x02\x03\x04", test_data + 0x10, 6);
+  TEST_ASSERT_EQUAL(4, Sim::n_transfers);
+  TEST_ASSERT_EQUAL(2, Sim::n_latches);
+
+  // 10 bits per character, newline sent as CR LF
+  test_io.clear();
+  Sim::print_string("ab");
+  Sim::newline();
+  TEST_ASSERT_EQUAL_STRING("ab\n", test_io.contents());
+  TEST_ASSERT_EQUAL(4, Sim::n_chars);
+  TEST_ASSERT_EQUAL(40724, Sim::elapsed_ns);
+}
+
+void test_stats() {
+  static const uint8_t code[] = {
+    0x21, 0x34, 0x12,       // 00: LD HL,$1234
+    0xDD, 0x7E, 0x01,       // 03: LD A,(IX+$01)
+    0xFD, 0xCB, 0x02, 0x46, // 06: BIT 0,(IY+$02)
+    0xED, 0xB0,             // 0A: LDIR
+    0xC9,                   // 0C: RET
+    0xED, 0x00,             // 0D: invalid
+  };
+  memset(test_data, 0, DATA_SIZE);
+  memcpy(test_data, code, sizeof(code));
+
+  OpcodeStats<TestAPI> stats;
+  stats.add(0, sizeof(code) - 1);
+  TEST_ASSERT_EQUAL(2, stats.count(MNE_LD));
+  TEST_ASSERT_EQUAL(6, stats.bytes(MNE_LD));
+  TEST_ASSERT_EQUAL(1, stats.count(MNE_BIT));
+  TEST_ASSERT_EQUAL(4, stats.bytes(MNE_BIT));
+  TEST_ASSERT_EQUAL(1, stats.count(MNE_INVALID));
+  TEST_ASSERT_EQUAL(0, stats.count(MNE_NOP));
+  TEST_ASSERT_EQUAL(1, stats.prefix(STATS_IX));
+  TEST_ASSERT_EQUAL(1, stats.prefix(STATS_IY));
+  TEST_ASSERT_EQUAL(2, stats.prefix(STATS_ED));
+  TEST_ASSERT_EQUAL(1, stats.prefix(STATS_CB));
+  TEST_ASSERT_EQUAL(6, stats.total_count());
+  TEST_ASSERT_EQUAL(sizeof(code), stats.total_bytes());
+
+  // Most frequent first, then alphabetical
+  static const uint8_t ORDER[] = { MNE_LD, MNE_BIT, MNE_LDIR, MNE_RET, MNE_INVALID };
+  uint8_t order[MNE_INVALID + 1];
+  TEST_ASSERT_EQUAL(sizeof(ORDER), stats.sort(order));
+  for (uint8_t i = 0; i < sizeof(ORDER); ++i) {
+    TEST_ASSERT_EQUAL(ORDER[i], order[i]);
+  }
+
+  // Per-mnemonic counts saturate on a full scan, totals do not
+  memset(test_data, 0, DATA_SIZE);
+  OpcodeStats<TestAPI> nops;
+  nops.add(0, 0xFFFF);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, nops.count(MNE_NOP));
+  TEST_ASSERT_EQUAL(0x10000, nops.total_count());
+}
+
+// Counts rows printed by find_range
+struct FindAPI : TestAPI {
+  static uint8_t n_rows;
+  static void print_char(char) {}
+  static void print_string(const char*) {}
+  static void newline() { ++n_rows; }
+};
+
+uint8_t FindAPI::n_rows;
+
+void test_find() {
+  static const uint8_t code[] = {
+    0xCD, 0x05, 0x00,       // 00: CALL $0005
+    0xDD, 0x7E, 0x10,       // 03: LD A,(IX+$10)
+    0xCD, 0x06, 0x00,       // 06: CALL $0006
+    0xFD, 0x7E, 0xF0,       // 09: LD A,(IY-$10)
+    0xDD, 0x46, 0x01,       // 0C: LD B,(IX+$01)
+    0xC4, 0x05, 0x00,       // 0F: CALL NZ,$0005
+  };
+  memset(test_data, 0, DATA_SIZE);
+  memcpy(test_data, code, sizeof(code));
+
+  auto parse = [](Instruction& pattern, const char* str) {
+    test_io.clear();
+    test_io.try_insert(str);
+    uCLI::Tokens args(test_io.contents());
+    TEST_ASSERT_TRUE_MESSAGE(parse_instruction<TestAPI>(pattern, args, nullptr, true), str);
+  };
+
+  // Count matches in range, including one that ends it
+  auto count = [&parse](const char* str) {
+    Instruction pattern;
+    parse(pattern, str);
+    FindAPI::n_rows = 0;
+    TEST_ASSERT_EQUAL_HEX16(sizeof(code), (find_range<FindAPI>(0, sizeof(code) - 1, pattern)));
+    return FindAPI::n_rows;
+  };
+
+  TEST_ASSERT_EQUAL(1, count("CALL $0005"));
+  TEST_ASSERT_EQUAL(2, count("CALL *"));
+  TEST_ASSERT_EQUAL(1, count("CALL *,*"));
+  TEST_ASSERT_EQUAL(1, count("LD A,(IX+*)"));
+  TEST_ASSERT_EQUAL(2, count("LD A,(*)"));
+  TEST_ASSERT_EQUAL(3, count("LD *,*"));
+
+  // Stop after a page of rows, resuming after the last match
+  Instruction call;
+  parse(call, "CALL *");
+  TEST_ASSERT_EQUAL_HEX16(0x03, (find_range<FindAPI, 1>(0, sizeof(code) - 1, call)));
+  TEST_ASSERT_EQUAL_HEX16(0x09, (find_range<FindAPI, 1>(0x03, sizeof(code) - 1, call)));
+
+  // Search across the end of memory
+  memset(test_data, 0, DATA_SIZE);
+  memcpy(test_data + 0xFF, code, 1);
+  memcpy(test_data, code + 1, 2);
+  FindAPI::n_rows = 0;
+  TEST_ASSERT_EQUAL_HEX16(0x0002, (find_range<FindAPI>(0xFFF0, 0x0001, call)));
+  TEST_ASSERT_EQUAL(1, FindAPI::n_rows);
+
+  // Only opcodes that can decode to the mnemonic are candidates
+  uint8_t bits[32];
+  find_candidates<TestAPI>(MNE_CALL, bits);
+  auto is_candidate = [&bits](uint8_t code) { return (bits[code / 8] & (1 << (code % 8))) != 0; };
+  TEST_ASSERT_TRUE(is_candidate(0xCD));
+  TEST_ASSERT_TRUE(is_candidate(0xC4));
+  TEST_ASSERT_TRUE(is_candidate(PREFIX_IX));
+  TEST_ASSERT_FALSE(is_candidate(0x00));
+  TEST_ASSERT_FALSE(is_candidate(0x7E));
+
+  // Wildcards are only for patterns
+  test_io.clear();
+  test_io.try_insert("LD A,*");
+  Instruction inst;
+  TEST_ASSERT_FALSE(parse_instruction<TestAPI>(inst, uCLI::Tokens(test_io.contents())));
+}
+
+void test_regions() {
+  uMon::RegionsOwner<3> regions;
+  uint16_t end;
+  TEST_ASSERT_TRUE(regions.mark(0x10, 0x1F, uMon::REGION_BYTE));
+  TEST_ASSERT_TRUE(regions.mark(0x20, 0x2F, uMon::REGION_BYTE));
+  TEST_ASSERT_EQUAL(1, regions.entries()); // merged with neighbor
+  TEST_ASSERT_EQUAL(uMon::REGION_BYTE, regions.get_type(0x2F, end));
+  TEST_ASSERT_EQUAL(0x2F, end);
+  TEST_ASSERT_EQUAL(uMon::REGION_CODE, regions.get_type(0x08, end));
+  TEST_ASSERT_EQUAL(0x0F, end);
+
+  // Split existing region around new one
+  TEST_ASSERT_TRUE(regions.mark(0x18, 0x19, uMon::REGION_WORD));
+  TEST_ASSERT_EQUAL(3, regions.entries());
+  TEST_ASSERT_EQUAL(uMon::REGION_WORD, regions.get_type(0x19, end));
+  TEST_ASSERT_EQUAL(uMon::REGION_BYTE, regions.get_type(0x1A, end));
+  TEST_ASSERT_EQUAL(0x2F, end);
+  TEST_ASSERT_FALSE(regions.mark(0x1C, 0x1C, uMon::REGION_TEXT));
+
+  // Wrapped range that does not fit changes nothing
+  TEST_ASSERT_TRUE(regions.mark(0x18, 0x19, uMon::REGION_BYTE));
+  TEST_ASSERT_TRUE(regions.mark(0x80, 0x8F, uMon::REGION_BYTE));
+  TEST_ASSERT_FALSE(regions.mark(0xFFF0, 0x0005, uMon::REGION_TEXT));
+  TEST_ASSERT_EQUAL(2, regions.entries());
+  TEST_ASSERT_EQUAL(uMon::REGION_CODE, regions.get_type(0xFFF0, end));
+
+  // Replace all with code
+  TEST_ASSERT_TRUE(regions.mark(0x00, 0xFF, uMon::REGION_CODE));
+  TEST_ASSERT_EQUAL(0, regions.entries());
+  TEST_ASSERT_EQUAL(uMon::REGION_CODE, regions.get_type(0x19, end));
+  TEST_ASSERT_EQUAL(0xFFFF, end);
+}
+
+void test_labels() {
+  uMon::LabelsOwner<64> labels;
+  TEST_ASSERT_TRUE(labels.set_label("c", 0x30));
+  TEST_ASSERT_TRUE(labels.set_label("a", 0x10));
+  TEST_ASSERT_TRUE(labels.set_label("b", 0x20));
+  TEST_ASSERT_TRUE(labels.set_label("b2", 0x20));
+  TEST_ASSERT_TRUE(labels.set_label("a", 0x40)); // move to end
+
+  // Entries are sorted by address, then by order of insertion
+  static const char* const NAMES[] = { "b", "b2", "c", "a" };
+  const char* name;
+  uint16_t addr;
+  for (uint8_t i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(labels.get_index(i, name, addr));
+    TEST_ASSERT_EQUAL_STRING(NAMES[i], name);
+  }
+
+  // Walk from cursor
+  auto cursor = labels.seek(0x21);
+  TEST_ASSERT_TRUE(labels.get_cursor(cursor, name, addr));
+  TEST_ASSERT_EQUAL(0x30, addr);
+  labels.next(cursor);
+  TEST_ASSERT_TRUE(labels.get_cursor(cursor, name, addr));
+  TEST_ASSERT_EQUAL_STRING("a", name);
+  labels.next(cursor);
+  TEST_ASSERT_FALSE(labels.get_cursor(cursor, name, addr));
+
+  TEST_ASSERT_TRUE(labels.get_name(0x20, name));
+  TEST_ASSERT_EQUAL_STRING("b", name);
+  TEST_ASSERT_FALSE(labels.get_name(0x10, name));
+}
+
 template <uint8_t N>
 void assert_sorted(const char* const (&table)[N]) {
   for (uint8_t i = 1; i < N; ++i) {
@@ -338,12 +1613,58 @@ void test_str_sort() {
   assert_sorted(TOK_STR);
 }
 
+template <typename Hash, uint8_t N>
+void assert_hashed(const char* const (&table)[N]) {
+  char lower[8];
+  for (uint8_t i = 0; i < N; ++i) {
+    const char* entry = table[i];
+    TEST_ASSERT_EQUAL_MESSAGE(i, uMon::pgm_hash_find<Hash>(table, entry), entry);
+    // Assert lookup ignores case
+    uint8_t j = 0;
+    for (; entry[j] != '\0'; ++j) lower[j] = tolower(entry[j]);
+    lower[j] = '\0';
+    TEST_ASSERT_EQUAL_MESSAGE(i, uMon::pgm_hash_find<Hash>(table, lower), entry);
+  }
+  TEST_ASSERT_EQUAL(N, uMon::pgm_hash_find<Hash>(table, "XYZZY"));
+  TEST_ASSERT_EQUAL(N, uMon::pgm_hash_find<Hash>(table, ""));
+}
+
+void test_str_hash() {
+  assert_hashed<MneHash>(MNE_STR);
+  assert_hashed<TokHash>(TOK_STR);
+}
+
 int main(int argc, char* argv[]) {
   UNITY_BEGIN();
   RUN_TEST(test_str_sort);
+  RUN_TEST(test_str_hash);
   RUN_TEST(test_asm_misc);
+  RUN_TEST(test_asm_fixed);
   RUN_TEST(test_asm_ld_r);
   RUN_TEST(test_asm_alu_r);
   RUN_TEST(test_asm_inc_r);
+  RUN_TEST(test_stack);
+  RUN_TEST(test_dasm_prev);
+  RUN_TEST(test_dasm_length);
+  RUN_TEST(test_instruction_range);
+  RUN_TEST(test_asm_stage);
+  RUN_TEST(test_casm);
+  RUN_TEST(test_asm_batch);
+  RUN_TEST(test_asm_relax);
+  RUN_TEST(test_fixups);
+  RUN_TEST(test_reloc);
+  RUN_TEST(test_emu);
+  RUN_TEST(test_emu_cache);
+  RUN_TEST(test_profile);
+  RUN_TEST(test_snapshot);
+  RUN_TEST(test_ports);
+  RUN_TEST(test_casm_match);
+  RUN_TEST(test_debug);
+  RUN_TEST(test_target);
+  RUN_TEST(test_sim);
+  RUN_TEST(test_stats);
+  RUN_TEST(test_find);
+  RUN_TEST(test_regions);
+  RUN_TEST(test_labels);
   UNITY_END();
 }